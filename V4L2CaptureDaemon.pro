@@ -0,0 +1,39 @@
+#-------------------------------------------------
+#
+# Headless capture daemon, no Qt and no OpenCV
+#
+#-------------------------------------------------
+
+TARGET = V4L2CaptureDaemon
+TEMPLATE = app
+
+CONFIG  += console c++11
+CONFIG  -= qt app_bundle
+
+QMAKE_CXXFLAGS += -Wall -Wextra -pedantic
+
+LIBS += -pthread
+
+SOURCES += \
+    capturedaemon.cpp \
+    v4l2device.cpp \
+    v4l2convert.cpp \
+    framediff.cpp \
+    imagestats.cpp \
+    framecodec.cpp \
+    framerecorder.cpp \
+    threadpool.cpp \
+    pipeline.cpp \
+    pipelinestages.cpp
+
+HEADERS += \
+    v4l2device.h \
+    v4l2convert.h \
+    framediff.h \
+    imagestats.h \
+    framecodec.h \
+    framerecorder.h \
+    boundedqueue.h \
+    threadpool.h \
+    pipeline.h \
+    pipelinestages.h
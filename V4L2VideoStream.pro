@@ -7,6 +7,7 @@
 QT       += core gui
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+greaterThan(QT_MAJOR_VERSION, 5): QT += openglwidgets
 OPE
 TARGET = V4L2VideoStream
 TEMPLATE = app
@@ -31,11 +32,19 @@ DEFINES += QT_DEPRECATED_WARNINGS
 SOURCES += \
         main.cpp \
     v4l2device.cpp \
-    videostreamer.cpp
+    v4l2convert.cpp \
+    videostreamer.cpp \
+    frameview.cpp \
+    framediff.cpp \
+    imagestats.cpp
 
 HEADERS += \
     v4l2device.h \
-    videostreamer.h
+    v4l2convert.h \
+    videostreamer.h \
+    frameview.h \
+    framediff.h \
+    imagestats.h
 
 FORMS += \
     videostreamer.ui
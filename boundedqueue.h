@@ -0,0 +1,129 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+using namespace std;
+
+#define CACHE_LINE_SIZE 64
+
+/**
+ * Bounded lock-free multi-producer multi-consumer queue (D. Vyukov's algorithm).
+ * Capacity is rounded up to a power of two (at least 2).
+ */
+template <typename T>
+class BoundedQueue {
+
+public:
+
+    explicit BoundedQueue(size_t capacity) :
+        _capacity(round_capacity(capacity)), _mask(_capacity - 1),
+        _cells(new Cell[_capacity]), _enqueue_pos(0), _dequeue_pos(0)
+    {
+        for (size_t i = 0; i < _capacity; ++i) {
+            _cells[i].sequence.store(i, memory_order_relaxed);
+        }
+    }
+
+    /* Prohibit copy constructor and assignment operator */
+    BoundedQueue(const BoundedQueue&)            = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    /* returns false if the queue is full */
+    bool tryPush(const T &value) {
+
+        size_t pos = _enqueue_pos.load(memory_order_relaxed);
+
+        while (true) {
+
+            Cell &cell = _cells[pos & _mask];
+
+            size_t sequence = cell.sequence.load(memory_order_acquire);
+            ptrdiff_t diff  = (ptrdiff_t) sequence - (ptrdiff_t) pos;
+
+            if (diff == 0) {
+                if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.sequence.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = _enqueue_pos.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    /* returns false if the queue is empty */
+    bool tryPop(T &value) {
+
+        size_t pos = _dequeue_pos.load(memory_order_relaxed);
+
+        while (true) {
+
+            Cell &cell = _cells[pos & _mask];
+
+            size_t sequence = cell.sequence.load(memory_order_acquire);
+            ptrdiff_t diff  = (ptrdiff_t) sequence - (ptrdiff_t) (pos + 1);
+
+            if (diff == 0) {
+                if (_dequeue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    value = move(cell.value); // the cell releases its reference at once
+                    cell.value = T();
+                    cell.sequence.store(pos + _mask + 1, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // empty
+            } else {
+                pos = _dequeue_pos.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    /* approximate number of queued elements */
+    size_t size() const {
+
+        size_t enqueued = _enqueue_pos.load(memory_order_relaxed);
+        size_t dequeued = _dequeue_pos.load(memory_order_relaxed);
+
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    size_t capacity() const {
+        return _capacity;
+    }
+
+private:
+
+    struct Cell {
+        atomic<size_t> sequence;
+        T value;
+    };
+
+    static size_t round_capacity(size_t capacity) {
+
+        size_t rounded = 2;
+
+        while (rounded < capacity) rounded <<= 1;
+
+        return rounded;
+    }
+
+    const size_t _capacity;
+    const size_t _mask;
+
+    unique_ptr<Cell[]> _cells;
+
+    /* producers and consumers don't share a cache line (no over-aligned new in C++11) */
+    char _padding0[CACHE_LINE_SIZE];
+    atomic<size_t> _enqueue_pos;
+    char _padding1[CACHE_LINE_SIZE - sizeof(atomic<size_t>)];
+    atomic<size_t> _dequeue_pos;
+    char _padding2[CACHE_LINE_SIZE - sizeof(atomic<size_t>)];
+};
+
+#endif // BOUNDEDQUEUE_H
@@ -0,0 +1,469 @@
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "v4l2device.h"
+#include "framerecorder.h"
+#include "pipeline.h"
+#include "pipelinestages.h"
+
+/*
+ * Headless capture daemon: the capture core without Qt.
+ *
+ * Usage: V4L2CaptureDaemon [--config FILE] [--interval SEC] [--threads N] --device PATH [camera options] ...
+ * Each --device starts a new camera, the following options apply to it:
+ *   --width N --height N --fps N --format FOURCC --buffers N --memory mmap|userptr
+ *   --change-threshold X --stats-step N --convert --scale N --record FILE --codec raw|lossless
+ *   --roi WxH+LEFT+TOP (sensor crop if supported, otherwise cut out of the captured frame)
+ *   --low-latency (drain to newest with LOW_LATENCY_BUFFER_SIZE buffers, put --buffers after it to override)
+ *
+ * Config file: "[camera]" starts a new camera, "key = value" lines use the option names
+ * without dashes ("convert = 1"), "#" starts a comment.
+ *
+ * Frames of each camera go through a pipeline on the shared thread pool:
+ * source -> record, source -> convert -> scale -> sink.
+ * The pipeline is fed after the device's change gate and drain to newest mode, so --record
+ * can't be combined with --change-threshold or --low-latency (the recording would miss frames).
+ */
+
+#define STATS_INTERVAL 5
+
+using namespace std;
+
+/**
+ * Camera configuration
+ */
+typedef struct {
+    v4l2_device_param device;
+    bool convert = false;
+    unsigned int scale = 1;
+    string record_file;
+    unsigned int codec = CODEC_LOSSLESS;
+} camera_config;
+
+/**
+ * Running camera: device, processing pipeline and sink state.
+ * Frames in the pipeline may hold the device's buffers: the device is stopped,
+ * then the pipeline is destroyed (releasing the buffers) and the device last.
+ */
+struct camera_session {
+    camera_config config;
+
+    unique_ptr<V4L2Device> device;
+
+    unique_ptr<Pipeline> pipeline;
+    shared_ptr<FrameRecorder> recorder;
+
+    /* sink statistics, reset on every report */
+    atomic<unsigned long long> frames;
+    atomic<unsigned long long> bytes;
+    atomic<unsigned long long> latency_sum; // microseconds
+    atomic<unsigned long long> latency_count;
+    atomic<unsigned long long> latency_max;
+
+    ~camera_session() {
+
+        if (device) {
+            try {
+                device->stopCapturing();
+            } catch (const exception &e) {
+                cerr << device->getDevice() << ": " << e.what() << endl;
+            }
+        }
+
+        // waits for the running stages, queued frames release the held buffers
+        pipeline.reset();
+    }
+};
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int) {
+    stop_requested = 1;
+}
+
+// ============== Config ============== //
+
+static unsigned int parse_format(const string &name) {
+
+    static const struct {
+        const char *name;
+        unsigned int format;
+    } formats[] = {
+        {"YUYV",   V4L2_PIX_FMT_YUYV},
+        {"GREY",   V4L2_PIX_FMT_GREY},
+        {"SBGGR8", V4L2_PIX_FMT_SBGGR8},
+        {"SGBRG8", V4L2_PIX_FMT_SGBRG8},
+        {"SGRBG8", V4L2_PIX_FMT_SGRBG8},
+        {"SRGGB8", V4L2_PIX_FMT_SRGGB8},
+    };
+
+    for (auto &f : formats) {
+        if (name == f.name) return f.format;
+    }
+
+    // any other fourcc code, as printed by v4l2-ctl
+    if (name.size() == 4) {
+        return v4l2_fourcc(name[0], name[1], name[2], name[3]);
+    }
+
+    throw runtime_error("Unknown pixel format " + name);
+}
+
+static unsigned int parse_memory(const string &name) {
+
+    if (name == "mmap")    return V4L2_MEMORY_MMAP;
+    if (name == "userptr") return V4L2_MEMORY_USERPTR;
+
+    throw runtime_error("Unknown memory type " + name);
+}
+
+static unsigned int parse_codec(const string &name) {
+
+    if (name == "raw")      return CODEC_RAW;
+    if (name == "lossless") return CODEC_LOSSLESS;
+
+    throw runtime_error("Unknown codec " + name);
+}
+
+/* "WxH+LEFT+TOP", offsets may be omitted */
+static struct v4l2_rect parse_roi(const string &geometry) {
+
+    struct v4l2_rect roi = {0, 0, 0, 0};
+
+    unsigned int width = 0, height = 0;
+    int left = 0, top = 0;
+
+    if (sscanf(geometry.c_str(), "%ux%u+%d+%d", &width, &height, &left, &top) < 2) {
+        throw runtime_error("Wrong ROI " + geometry + ", expected WxH+LEFT+TOP");
+    }
+
+    roi.left   = left;
+    roi.top    = top;
+    roi.width  = width;
+    roi.height = height;
+
+    return roi;
+}
+
+static void apply_option(camera_config &camera, const string &key, const string &value) {
+
+    v4l2_device_param &p = camera.device;
+
+    if (key == "device") {
+        p.dev_name = value;
+    } else if (key == "width") {
+        p.width = stoul(value);
+    } else if (key == "height") {
+        p.height = stoul(value);
+    } else if (key == "fps") {
+        p.numerator   = 1;
+        p.denominator = stoul(value);
+    } else if (key == "format") {
+        p.pixel_format = parse_format(value);
+    } else if (key == "buffers") {
+        p.n_buffers = stoul(value);
+    } else if (key == "memory") {
+        p.memory = parse_memory(value);
+    } else if (key == "low-latency") {
+        p.drain_to_newest = value != "0";
+        if (p.drain_to_newest) p.n_buffers = LOW_LATENCY_BUFFER_SIZE;
+    } else if (key == "roi") {
+        p.roi = parse_roi(value);
+    } else if (key == "change-threshold") {
+        p.change_threshold = stod(value);
+    } else if (key == "stats-step") {
+        p.stats_step = stoul(value);
+    } else if (key == "convert") {
+        camera.convert = value != "0";
+    } else if (key == "scale") {
+        camera.scale = stoul(value);
+    } else if (key == "record") {
+        camera.record_file = value;
+    } else if (key == "codec") {
+        camera.codec = parse_codec(value);
+    } else {
+        throw runtime_error("Unknown option " + key);
+    }
+}
+
+static string trim(const string &s) {
+
+    size_t first = s.find_first_not_of(" \t\r");
+    size_t last  = s.find_last_not_of(" \t\r");
+
+    return (first == string::npos) ? string() : s.substr(first, last - first + 1);
+}
+
+static void read_config(const string &file_name, vector<camera_config> &cameras, unsigned int &interval) {
+
+    ifstream file(file_name);
+
+    if (!file) {
+        throw runtime_error(file_name + ": cannot open! " + strerror(errno));
+    }
+
+    string line;
+
+    while (getline(file, line)) {
+
+        line = trim(line.substr(0, line.find('#')));
+
+        if (line.empty()) continue;
+
+        if (line == "[camera]") {
+            cameras.push_back(camera_config());
+            continue;
+        }
+
+        size_t eq = line.find('=');
+
+        if (eq == string::npos) {
+            throw runtime_error(file_name + ": invalid line \"" + line + "\"");
+        }
+
+        string key   = trim(line.substr(0, eq));
+        string value = trim(line.substr(eq + 1));
+
+        if (key == "interval") {
+            interval = stoul(value);
+        } else if (cameras.empty()) {
+            throw runtime_error(file_name + ": \"" + key + "\" outside of [camera]");
+        } else {
+            apply_option(cameras.back(), key, value);
+        }
+    }
+}
+
+/* recording is fed by the device's callback, it must get every captured frame */
+static void check_camera(const camera_config &camera) {
+
+    if (camera.record_file.empty()) return;
+
+    if (camera.device.change_threshold > 0) {
+        throw runtime_error(camera.device.dev_name + ": --record can't be used with --change-threshold");
+    }
+
+    if (camera.device.drain_to_newest) {
+        throw runtime_error(camera.device.dev_name + ": --record can't be used with --low-latency");
+    }
+}
+
+static void parse_arguments(int argc, char *argv[], vector<camera_config> &cameras,
+                            unsigned int &interval, unsigned int &threads) {
+
+    for (int i = 1; i < argc; ++i) {
+
+        string arg = argv[i];
+
+        if (arg == "--help" || arg == "-h") {
+            cout << "Usage: " << argv[0] << " [--config FILE] [--interval SEC] [--threads N] --device PATH [options] ...\n"
+                    "  --width N --height N --fps N --format FOURCC --buffers N --memory mmap|userptr\n"
+                    "  --change-threshold X --stats-step N --convert --scale N --record FILE --codec raw|lossless\n"
+                    "  --roi WxH+LEFT+TOP\n"
+                    "  --low-latency\n"
+                    "  --record takes every captured frame, it excludes --change-threshold and --low-latency" << endl;
+            exit(0);
+        }
+
+        if (arg.compare(0, 2, "--") != 0) {
+            throw runtime_error("Unexpected argument " + arg);
+        }
+
+        string key = arg.substr(2);
+
+        if (key == "convert" || key == "low-latency") { // flags without value
+            if (cameras.empty()) throw runtime_error(arg + " before --device");
+            apply_option(cameras.back(), key, "1");
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            throw runtime_error("Missing value of " + arg);
+        }
+
+        string value = argv[++i];
+
+        if (key == "config") {
+            read_config(value, cameras, interval);
+        } else if (key == "interval") {
+            interval = stoul(value);
+        } else if (key == "threads") {
+            threads = stoul(value);
+        } else {
+            if (key == "device") cameras.push_back(camera_config());
+            if (cameras.empty()) throw runtime_error(arg + " before --device");
+            apply_option(cameras.back(), key, value);
+        }
+    }
+
+    for (auto &camera : cameras) {
+        check_camera(camera);
+    }
+}
+
+// ============== Pipeline ============== //
+
+/* the last stage: glass-to-sink latency and throughput */
+static FramePtr sink_frame(camera_session &session, const FramePtr &frame) {
+
+    session.frames++;
+    session.bytes += (unsigned long long) frame->stride * frame->height;
+
+    if (!frame->timestamp_monotonic) return nullptr; // not comparable with CLOCK_MONOTONIC
+
+    unsigned long long latency = timestamp_latency(frame->timestamp);
+
+    session.latency_sum += latency;
+    session.latency_count++;
+
+    if (latency > session.latency_max) session.latency_max = latency;
+
+    return nullptr;
+}
+
+static unique_ptr<camera_session> open_camera(const camera_config &config, ThreadPool &pool) {
+
+    unique_ptr<camera_session> session(new camera_session());
+
+    camera_session *s = session.get();
+
+    session->config = config;
+    session->pipeline.reset(new Pipeline(pool));
+
+    Pipeline &pipeline = *session->pipeline;
+
+    if (!config.record_file.empty()) {
+        session->recorder = make_shared<FrameRecorder>(config.record_file, config.codec, &pool);
+
+        /* recording must not lose frames */
+        pipeline.addStage("record", make_record_stage(session->recorder), PIPELINE_SOURCE, BLOCK, 2 * QUEUE_CAPACITY);
+    }
+
+    int last = PIPELINE_SOURCE;
+
+    if (config.convert) {
+        last = pipeline.addStage("convert", make_convert_stage(), last);
+    }
+
+    if (config.scale > 1) {
+        last = pipeline.addStage("scale", make_scale_stage(config.scale), last);
+    }
+
+    pipeline.addStage("sink", [s](const FramePtr &frame) {
+        return sink_frame(*s, frame);
+    }, last);
+
+    session->device.reset(new V4L2Device(config.device));
+
+    session->device->setCallback([s](const Buffer &buffer, const struct v4l2_buffer &buffer_info) {
+        s->pipeline->push(make_frame(*s->device, buffer, buffer_info));
+    });
+
+    return session;
+}
+
+static void report(vector<unique_ptr<camera_session>> &sessions, double seconds) {
+
+    for (auto &session : sessions) {
+
+        v4l2_stream_stats stats = session->device->getStreamStatistics();
+
+        unsigned long long frames = session->frames.exchange(0);
+        unsigned long long bytes  = session->bytes.exchange(0);
+        unsigned long long sum    = session->latency_sum.exchange(0);
+        unsigned long long count  = session->latency_count.exchange(0);
+        unsigned long long max    = session->latency_max.exchange(0);
+
+        printf("%s: %.1f fps, %.1f MB/s, glass-to-sink avg %.1f ms max %.1f ms, "
+               "glass-to-consumer avg %.1f ms max %.1f ms, skipped %.1f%%, stale dropped %llu",
+               session->device->getDevice().c_str(),
+               frames / seconds, bytes / seconds / 1e6,
+               count ? sum / 1e3 / count : 0.0, max / 1e3,
+               stats.latency_avg, stats.latency_max,
+               stats.skip_rate * 100, stats.frames_dropped);
+
+        if (session->recorder && session->recorder->getWrittenBytes()) {
+            printf(", recording ratio %.2f",
+                   (double) session->recorder->getRawBytes() / session->recorder->getWrittenBytes());
+        }
+
+        printf("\n");
+
+        for (auto &stage : session->pipeline->getStatistics()) {
+            printf("    %-8s processed %llu, dropped %llu, failed %llu, queued %u, avg %.2f ms, max %.2f ms\n",
+                   stage.name.c_str(), stage.processed, stage.dropped, stage.failed,
+                   stage.queued, stage.avg_ms, stage.max_ms);
+        }
+    }
+
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+
+    vector<camera_config> cameras;
+    unsigned int interval = STATS_INTERVAL;
+    unsigned int threads  = 0;
+
+    try {
+        parse_arguments(argc, argv, cameras, interval, threads);
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    if (cameras.empty()) {
+        cerr << "No devices, see --help" << endl;
+        return 1;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    /* shared by all cameras, outlives the pipelines */
+    ThreadPool pool(threads);
+
+    vector<unique_ptr<camera_session>> sessions;
+
+    try {
+        for (auto &config : cameras) {
+            sessions.push_back(open_camera(config, pool));
+        }
+
+        for (auto &session : sessions) {
+            session->device->startCapturing();
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1; // the started cameras are stopped by their sessions
+    }
+
+    auto last_report = chrono::steady_clock::now();
+
+    while (!stop_requested) {
+
+        this_thread::sleep_for(chrono::milliseconds(100));
+
+        auto now = chrono::steady_clock::now();
+        double elapsed = chrono::duration<double>(now - last_report).count();
+
+        if (elapsed >= interval) {
+            report(sessions, elapsed);
+            last_report = now;
+        }
+    }
+
+    // the sessions stop their devices before the pipelines are destroyed, on every exit path
+    sessions.clear();
+
+    return 0;
+}
@@ -0,0 +1,947 @@
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <queue>
+#include <algorithm>
+#include <linux/videodev2.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "framecodec.h"
+
+#define CODEC_MAGIC 0x31434c4c // "LLC1"
+
+/* longest Huffman code, the decoder's lookup table has 1 << HUFFMAN_MAX_BITS entries */
+#define HUFFMAN_MAX_BITS 12
+#define HUFFMAN_SYMBOLS  256
+
+/* code lengths are stored as nibbles */
+#define HUFFMAN_TABLE_SIZE (HUFFMAN_SYMBOLS / 2)
+
+/* every n-th byte is used to choose the row predictor, odd to hit all phases */
+#define PREDICTOR_SAMPLE 13
+
+enum Predictor { PRED_LEFT = 0, PRED_UP = 1, PRED_PAETH = 2 };
+
+/**
+ * Stream header, followed by bands sizes (uint32_t each) and bands payloads.
+ * Band payload: predictor per row (1 byte each), Huffman code lengths of the band
+ * (HUFFMAN_TABLE_SIZE bytes) and the coded residuals.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t line_bytes;
+    uint32_t height;
+    uint32_t pixel_format;
+    uint32_t bands;
+} StreamHeader;
+
+/**
+ * Distances (in bytes/rows) to the nearest sample of the same phase
+ */
+typedef struct {
+    unsigned int left_even; // for the bytes at even positions
+    unsigned int left_odd;  // for the bytes at odd positions
+    unsigned int up;        // rows
+} Layout;
+
+static Layout layout_of(unsigned int pixel_format) {
+
+    switch (pixel_format) {
+        case V4L2_PIX_FMT_YUYV:
+        case V4L2_PIX_FMT_YVYU:
+            return Layout{2, 4, 1};
+        case V4L2_PIX_FMT_UYVY:
+        case V4L2_PIX_FMT_VYUY:
+            return Layout{4, 2, 1};
+        case V4L2_PIX_FMT_SBGGR8:
+        case V4L2_PIX_FMT_SGBRG8:
+        case V4L2_PIX_FMT_SGRBG8:
+        case V4L2_PIX_FMT_SRGGB8:
+            return Layout{2, 2, 2};
+        default:
+            return Layout{1, 1, 1};
+    }
+}
+
+static inline unsigned int left_distance(const Layout &layout, unsigned int i) {
+    return (i & 1) ? layout.left_odd : layout.left_even;
+}
+
+/* branchless, the choice is unpredictable on noisy rows */
+static inline unsigned char paeth(int a, int b, int c) {
+
+    int pa = abs(b - c);
+    int pb = abs(a - c);
+    int pc = abs(a + b - 2 * c);
+
+    int bc = b ^ ((b ^ c) & -(pb > pc));
+
+    return (unsigned char) (a ^ ((a ^ bc) & -((pa > pb) | (pa > pc))));
+}
+
+/* up is nullptr when there is no row above within the band */
+static inline unsigned char predict(int mode, const unsigned char *cur, const unsigned char *up,
+                                    unsigned int i, unsigned int d) {
+
+    bool has_left = i >= d;
+
+    if (!up) return has_left ? cur[i - d] : 0;
+    if (!has_left || mode == PRED_UP) return up[i];
+    if (mode == PRED_LEFT) return cur[i - d];
+
+    return paeth(cur[i - d], up[i], up[i - d]);
+}
+
+/* maps signed residual to 0, 1, 2, ... for -0, -1, 1, -2, 2 ... */
+static inline unsigned char zigzag(unsigned char r) {
+    return (unsigned char) ((r << 1) ^ ((signed char) r >> 7));
+}
+
+static inline unsigned char unzigzag(unsigned char z) {
+    return (unsigned char) ((z >> 1) ^ -(z & 1));
+}
+
+// ============== Bit I/O ============== //
+
+/* little-endian bit order: the next code is in the lowest bits */
+typedef struct {
+
+    unsigned char *p;
+    uint64_t acc;
+    unsigned int n;
+
+    /* at most 56 bits may be pending, see store */
+    inline void put(uint64_t code, unsigned int bits) {
+        acc |= code << n;
+        n += bits;
+    }
+
+    /* writes the complete bytes, less than 8 bits stay pending (8 bytes of slack in the output) */
+    inline void store() {
+        memcpy(p, &acc, sizeof(acc));
+        p += n >> 3;
+        acc >>= n & ~7u;
+        n &= 7;
+    }
+
+    void flush() {
+        if (n) *p++ = (unsigned char) acc;
+        acc = 0;
+        n = 0;
+    }
+} BitWriter;
+
+typedef struct {
+
+    const unsigned char *p;
+    const unsigned char *end;
+    uint64_t acc;
+    unsigned int n;
+    unsigned int padding; // zero bytes fed beyond the end
+
+    /* at least 56 bits are available afterwards */
+    inline void refill() {
+
+        if (end - p >= 8) {
+            uint64_t word;
+            memcpy(&word, p, sizeof(word));
+            acc |= word << n;
+            p += (63 - n) >> 3;
+            n |= 56;
+            return;
+        }
+
+        while (n <= 56) {
+            if (p < end) {
+                acc |= (uint64_t) *p++ << n;
+            } else {
+                padding++;
+            }
+            n += 8;
+        }
+    }
+
+    inline void skip(unsigned int bits) {
+        acc >>= bits;
+        n -= bits;
+    }
+
+    bool overrun() const {
+        return padding * 8 > n;
+    }
+} BitReader;
+
+// ============== Huffman ============== //
+
+/* canonical code of the symbol, bit reversed for the little-endian bit order */
+typedef struct {
+    uint16_t code;
+    uint8_t  length;
+} HuffmanCode;
+
+static unsigned int reverse_bits(unsigned int code, unsigned int length) {
+
+    unsigned int reversed = 0;
+
+    for (unsigned int i = 0; i < length; ++i) {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+
+    return reversed;
+}
+
+/* lengths of the optimal code, halves the frequencies until the longest code fits HUFFMAN_MAX_BITS */
+static void huffman_lengths(const uint32_t *histogram, unsigned char *lengths) {
+
+    vector<uint32_t> frequency(histogram, histogram + HUFFMAN_SYMBOLS);
+
+    while (true) {
+
+        memset(lengths, 0, HUFFMAN_SYMBOLS);
+
+        /* nodes: symbols first, then the merged ones */
+        vector<int> parent(2 * HUFFMAN_SYMBOLS, -1);
+        priority_queue<pair<uint64_t, int>, vector<pair<uint64_t, int>>, greater<pair<uint64_t, int>>> queue;
+
+        for (int symbol = 0; symbol < HUFFMAN_SYMBOLS; ++symbol) {
+            if (frequency[symbol]) queue.push(make_pair((uint64_t) frequency[symbol], symbol));
+        }
+
+        if (queue.empty()) return;
+
+        if (queue.size() == 1) { // a code needs at least one bit
+            lengths[queue.top().second] = 1;
+            return;
+        }
+
+        int next = HUFFMAN_SYMBOLS;
+
+        while (queue.size() > 1) {
+
+            pair<uint64_t, int> a = queue.top(); queue.pop();
+            pair<uint64_t, int> b = queue.top(); queue.pop();
+
+            parent[a.second] = parent[b.second] = next;
+            queue.push(make_pair(a.first + b.first, next++));
+        }
+
+        unsigned int longest = 0;
+
+        for (int symbol = 0; symbol < HUFFMAN_SYMBOLS; ++symbol) {
+
+            if (!frequency[symbol]) continue;
+
+            unsigned int length = 0;
+            for (int node = symbol; parent[node] != -1; node = parent[node]) length++;
+
+            lengths[symbol] = (unsigned char) length;
+            longest = max(longest, length);
+        }
+
+        if (longest <= HUFFMAN_MAX_BITS) return;
+
+        for (auto &f : frequency) {
+            if (f) f = (f + 1) / 2;
+        }
+    }
+}
+
+/* canonical codes from the lengths (deflate's assignment), false if the lengths are not a prefix code */
+static bool huffman_codes(const unsigned char *lengths, HuffmanCode *codes) {
+
+    unsigned int count[HUFFMAN_MAX_BITS + 1] = {0};
+    unsigned int kraft = 0;
+
+    for (int symbol = 0; symbol < HUFFMAN_SYMBOLS; ++symbol) {
+
+        if (lengths[symbol] > HUFFMAN_MAX_BITS) return false;
+
+        if (lengths[symbol]) {
+            count[lengths[symbol]]++;
+            kraft += 1u << (HUFFMAN_MAX_BITS - lengths[symbol]);
+        }
+    }
+
+    if (kraft > (1u << HUFFMAN_MAX_BITS)) return false;
+
+    unsigned int next_code[HUFFMAN_MAX_BITS + 1] = {0};
+    unsigned int code = 0;
+
+    for (unsigned int length = 1; length <= HUFFMAN_MAX_BITS; ++length) {
+        code = (code + count[length - 1]) << 1;
+        next_code[length] = code;
+    }
+
+    for (int symbol = 0; symbol < HUFFMAN_SYMBOLS; ++symbol) {
+
+        unsigned int length = lengths[symbol];
+
+        codes[symbol].length = (uint8_t) length;
+        codes[symbol].code   = length ? (uint16_t) reverse_bits(next_code[length]++, length) : 0;
+    }
+
+    return true;
+}
+
+static void write_lengths(const unsigned char *lengths, unsigned char *output) {
+    for (int i = 0; i < HUFFMAN_TABLE_SIZE; ++i) {
+        output[i] = (unsigned char) (lengths[2 * i] | (lengths[2 * i + 1] << 4));
+    }
+}
+
+static void read_lengths(const unsigned char *input, unsigned char *lengths) {
+    for (int i = 0; i < HUFFMAN_TABLE_SIZE; ++i) {
+        lengths[2 * i]     = input[i] & 0x0F;
+        lengths[2 * i + 1] = input[i] >> 4;
+    }
+}
+
+// ============== Encoder ============== //
+
+#if defined(__SSE2__)
+
+static inline __m128i blend(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static inline __m128i abs16(__m128i x) {
+    return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+/* same selection rules as the scalar paeth, 16-bit lanes */
+static inline __m128i paeth16(__m128i a, __m128i b, __m128i c) {
+
+    __m128i pa = abs16(_mm_sub_epi16(b, c));
+    __m128i pb = abs16(_mm_sub_epi16(a, c));
+    __m128i pc = abs16(_mm_sub_epi16(_mm_add_epi16(a, b), _mm_add_epi16(c, c)));
+
+    __m128i not_a = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+    __m128i bc    = blend(_mm_cmpgt_epi16(pb, pc), c, b);
+
+    return blend(not_a, bc, a);
+}
+
+static inline __m128i paeth8(__m128i a, __m128i b, __m128i c) {
+
+    __m128i zero = _mm_setzero_si128();
+
+    __m128i lo = paeth16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+    __m128i hi = paeth16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+
+    return _mm_packus_epi16(lo, hi);
+}
+
+#endif
+
+/* zigzagged residuals of the row */
+static void row_residuals(int mode, const unsigned char *cur, const unsigned char *up,
+                          unsigned int n, const Layout &layout, unsigned char *residuals) {
+
+    unsigned int i = 0;
+
+#if defined(__SSE2__)
+    unsigned int d_max = (layout.left_even > layout.left_odd) ? layout.left_even : layout.left_odd;
+
+    /* head is coded by the scalar loop, the vector loop starts at even position */
+    unsigned int head = (d_max + 1) & ~1u;
+
+    for (; i < head && i < n; ++i) {
+        residuals[i] = zigzag((unsigned char) (cur[i] - predict(mode, cur, up, i, left_distance(layout, i))));
+    }
+
+    const __m128i odd  = _mm_set1_epi16((short) 0xFF00);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 16 <= n; i += 16) {
+
+        __m128i x    = _mm_loadu_si128((const __m128i*) (cur + i));
+        __m128i left = blend(odd, _mm_loadu_si128((const __m128i*) (cur + i - layout.left_odd)),
+                                  _mm_loadu_si128((const __m128i*) (cur + i - layout.left_even)));
+        __m128i pred = left;
+
+        if (up && mode != PRED_LEFT) {
+
+            __m128i above = _mm_loadu_si128((const __m128i*) (up + i));
+
+            if (mode == PRED_UP) {
+                pred = above;
+            } else {
+                __m128i above_left = blend(odd, _mm_loadu_si128((const __m128i*) (up + i - layout.left_odd)),
+                                                _mm_loadu_si128((const __m128i*) (up + i - layout.left_even)));
+                pred = paeth8(left, above, above_left);
+            }
+        }
+
+        __m128i r = _mm_sub_epi8(x, pred);
+        __m128i z = _mm_xor_si128(_mm_add_epi8(r, r), _mm_cmplt_epi8(r, zero));
+
+        _mm_storeu_si128((__m128i*) (residuals + i), z);
+    }
+#endif
+
+    for (; i < n; ++i) {
+        residuals[i] = zigzag((unsigned char) (cur[i] - predict(mode, cur, up, i, left_distance(layout, i))));
+    }
+}
+
+static int choose_predictor(const unsigned char *cur, const unsigned char *up,
+                            unsigned int n, const Layout &layout) {
+
+    if (!up) return PRED_LEFT;
+
+    unsigned int cost[3] = {0, 0, 0};
+
+    for (unsigned int i = 4; i < n; i += PREDICTOR_SAMPLE) {
+
+        unsigned int d = left_distance(layout, i);
+
+        cost[PRED_LEFT]  += zigzag((unsigned char) (cur[i] - cur[i - d]));
+        cost[PRED_UP]    += zigzag((unsigned char) (cur[i] - up[i]));
+        cost[PRED_PAETH] += zigzag((unsigned char) (cur[i] - paeth(cur[i - d], up[i], up[i - d])));
+    }
+
+    int best = PRED_LEFT;
+
+    if (cost[PRED_UP] < cost[best]) best = PRED_UP;
+    if (cost[PRED_PAETH] < cost[best]) best = PRED_PAETH;
+
+    return best;
+}
+
+static void huffman_encode(const unsigned char *values, size_t n, const HuffmanCode *codes, BitWriter &output) {
+
+    /* local copy, stores through the byte pointer would alias the members */
+    BitWriter writer = output;
+
+    size_t i = 0;
+
+    /* four codes (48 bits at most) per store */
+    for (; i + 4 <= n; i += 4) {
+        writer.put(codes[values[i]].code,     codes[values[i]].length);
+        writer.put(codes[values[i + 1]].code, codes[values[i + 1]].length);
+        writer.put(codes[values[i + 2]].code, codes[values[i + 2]].length);
+        writer.put(codes[values[i + 3]].code, codes[values[i + 3]].length);
+        writer.store();
+    }
+
+    for (; i < n; ++i) {
+        writer.put(codes[values[i]].code, codes[values[i]].length);
+        writer.store();
+    }
+
+    output = writer;
+}
+
+/* worst case: HUFFMAN_MAX_BITS per value, the predictors, the code lengths and the last store */
+static size_t band_capacity(unsigned int line_bytes, unsigned int rows) {
+    return rows + HUFFMAN_TABLE_SIZE + (size_t) rows * line_bytes * HUFFMAN_MAX_BITS / 8 + 8;
+}
+
+/* returns the number of bytes written */
+static size_t encode_band(const unsigned char *frame, unsigned int line_bytes, unsigned int stride,
+                          unsigned int first_row, unsigned int last_row, const Layout &layout,
+                          unsigned char *output) {
+
+    unsigned int rows = last_row - first_row;
+
+    /* the code is built from the residuals of the whole band */
+    /* reused between frames, a fresh allocation of this size page faults on every frame */
+    static thread_local vector<unsigned char> residuals;
+
+    if (residuals.size() < (size_t) rows * line_bytes) {
+        residuals.resize((size_t) rows * line_bytes);
+    }
+
+    for (unsigned int row = first_row; row < last_row; ++row) {
+
+        const unsigned char *cur = frame + (size_t) row * stride;
+        const unsigned char *up  = (row - first_row >= layout.up) ? cur - (size_t) layout.up * stride : nullptr;
+
+        int mode = choose_predictor(cur, up, line_bytes, layout);
+
+        output[row - first_row] = (unsigned char) mode;
+
+        row_residuals(mode, cur, up, line_bytes, layout, residuals.data() + (size_t) (row - first_row) * line_bytes);
+    }
+
+    size_t n = (size_t) rows * line_bytes;
+
+    /* four partial histograms hide the store-to-load dependency of repeated symbols */
+    uint32_t partial[4][HUFFMAN_SYMBOLS] = {{0}};
+    uint32_t histogram[HUFFMAN_SYMBOLS];
+
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        partial[0][residuals[i]]++;
+        partial[1][residuals[i + 1]]++;
+        partial[2][residuals[i + 2]]++;
+        partial[3][residuals[i + 3]]++;
+    }
+
+    for (; i < n; ++i) partial[0][residuals[i]]++;
+
+    for (int symbol = 0; symbol < HUFFMAN_SYMBOLS; ++symbol) {
+        histogram[symbol] = partial[0][symbol] + partial[1][symbol] + partial[2][symbol] + partial[3][symbol];
+    }
+
+    unsigned char lengths[HUFFMAN_SYMBOLS];
+    HuffmanCode codes[HUFFMAN_SYMBOLS];
+
+    huffman_lengths(histogram, lengths);
+    huffman_codes(lengths, codes);
+
+    write_lengths(lengths, output + rows);
+
+    BitWriter writer = {output + rows + HUFFMAN_TABLE_SIZE, 0, 0};
+
+    huffman_encode(residuals.data(), n, codes, writer);
+
+    writer.flush();
+
+    return writer.p - output;
+}
+
+void lossless_encode(const unsigned char *frame,
+                     unsigned int line_bytes, unsigned int height, unsigned int stride,
+                     unsigned int pixel_format, vector<unsigned char> &output,
+                     unsigned int bands, ThreadPool *pool) {
+
+    if (bands == 0) bands = 1;
+    if (bands > height) bands = height; // no bands for an empty frame
+
+    Layout layout = layout_of(pixel_format);
+
+    vector<unsigned int> first_row(bands + 1);
+    vector<size_t> band_offset(bands + 1);
+    vector<size_t> band_size(bands);
+
+    for (unsigned int band = 1; band <= bands; ++band) {
+        first_row[band] = (unsigned int) ((uint64_t) height * band / bands);
+    }
+
+    for (unsigned int band = 0; band < bands; ++band) {
+        band_offset[band + 1] = band_offset[band] + band_capacity(line_bytes, first_row[band + 1] - first_row[band]);
+    }
+
+    /* bands are coded at their worst case offsets, reused between frames */
+    static thread_local vector<unsigned char> scratch;
+
+    if (scratch.size() < band_offset[bands]) {
+        scratch.resize(band_offset[bands]);
+    }
+
+    unsigned char *coded = scratch.data(); // the jobs may run in other threads
+
+    auto job = [&](unsigned int band) {
+        band_size[band] = encode_band(frame, line_bytes, stride, first_row[band], first_row[band + 1],
+                                      layout, coded + band_offset[band]);
+    };
+
+    if (pool) {
+        pool->parallel(bands, job);
+    } else {
+        for (unsigned int band = 0; band < bands; ++band) job(band);
+    }
+
+    StreamHeader header = {CODEC_MAGIC, line_bytes, height, pixel_format, bands};
+
+    const unsigned char *bytes = (const unsigned char*) &header;
+    output.insert(output.end(), bytes, bytes + sizeof(header));
+
+    for (unsigned int band = 0; band < bands; ++band) {
+        uint32_t size = (uint32_t) band_size[band];
+        bytes = (const unsigned char*) &size;
+        output.insert(output.end(), bytes, bytes + sizeof(size));
+    }
+
+    for (unsigned int band = 0; band < bands; ++band) {
+        bytes = coded + band_offset[band];
+        output.insert(output.end(), bytes, bytes + band_size[band]);
+    }
+}
+
+// ============== Decoder ============== //
+
+/*
+ * Lookup table entry: up to three symbols decoded from the next HUFFMAN_MAX_BITS bits
+ * (bytes 0-2), their number (bits 24-25) and total code length (bits 26-29)
+ */
+#define ENTRY_COUNT(entry)  (((entry) >> 24) & 3)
+#define ENTRY_LENGTH(entry) ((entry) >> 26)
+
+/* single: symbol in the low byte, code length in the high one */
+static bool huffman_table(const unsigned char *lengths, uint16_t *single, uint32_t *table) {
+
+    HuffmanCode codes[HUFFMAN_SYMBOLS];
+
+    if (!huffman_codes(lengths, codes)) return false;
+
+    /* unused codes of an incomplete table decode as symbol 0 */
+    fill(single, single + (1 << HUFFMAN_MAX_BITS), (uint16_t) (1 << 8));
+
+    bool empty = true;
+
+    for (int symbol = 0; symbol < HUFFMAN_SYMBOLS; ++symbol) {
+
+        unsigned int length = codes[symbol].length;
+
+        if (!length) continue;
+
+        empty = false;
+
+        /* every index which starts with the code */
+        for (unsigned int index = codes[symbol].code; index < (1u << HUFFMAN_MAX_BITS); index += 1u << length) {
+            single[index] = (uint16_t) (symbol | (length << 8));
+        }
+    }
+
+    const unsigned int mask = (1u << HUFFMAN_MAX_BITS) - 1;
+
+    for (unsigned int index = 0; index <= mask; ++index) {
+
+        uint32_t entry = 0;
+        unsigned int count = 0, used = 0;
+
+        /* the first code always fits, the next ones while all their bits are known */
+        while (count < 3) {
+
+            uint16_t next = single[(index >> used) & mask];
+            unsigned int length = next >> 8;
+
+            if (count && used + length > HUFFMAN_MAX_BITS) break;
+
+            entry |= (uint32_t) (next & 0xFF) << (8 * count);
+            used  += length;
+            count++;
+        }
+
+        table[index] = entry | (count << 24) | (used << 26);
+    }
+
+    return !empty;
+}
+
+/* values must have 3 bytes of slack, entries are stored as whole words */
+static inline void huffman_decode(BitReader &input, const uint16_t *single, const uint32_t *table,
+                                  unsigned int n, unsigned char *values) {
+
+    const uint64_t mask = (1u << HUFFMAN_MAX_BITS) - 1;
+
+    /* local copy, stores to the values would alias the members */
+    BitReader reader = input;
+
+    unsigned int i = 0;
+
+    /* one refill gives 56 bits, enough for four lookups */
+    while (i + 12 <= n) {
+
+        reader.refill();
+
+        for (unsigned int j = 0; j < 4; ++j) {
+            uint32_t entry = table[reader.acc & mask];
+            memcpy(values + i, &entry, sizeof(entry));
+            i += ENTRY_COUNT(entry);
+            reader.skip(ENTRY_LENGTH(entry));
+        }
+    }
+
+    /* the tail symbol by symbol */
+    while (i < n) {
+        reader.refill();
+        uint16_t entry = single[reader.acc & mask];
+        values[i++] = (unsigned char) entry;
+        reader.skip(entry >> 8);
+    }
+
+    input = reader;
+}
+
+#if defined(__SSE2__)
+
+static inline __m128i unzigzag8(__m128i z) {
+
+    __m128i half = _mm_and_si128(_mm_srli_epi16(z, 1), _mm_set1_epi8(0x7F));
+    __m128i sign = _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(z, _mm_set1_epi8(1)));
+
+    return _mm_xor_si128(half, sign);
+}
+
+/* running sums of the bytes d apart (d = 1, 2 or 4) */
+static inline __m128i prefix8(__m128i x, unsigned int d) {
+
+    switch (d) {
+        case 1:  x = _mm_add_epi8(x, _mm_slli_si128(x, 1)); /* fall through */
+        case 2:  x = _mm_add_epi8(x, _mm_slli_si128(x, 2)); /* fall through */
+        default: x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+                 x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+    }
+
+    return x;
+}
+
+/* the last d bytes of x repeated over the vector */
+static inline __m128i carry8(__m128i x, unsigned int d) {
+
+    switch (d) {
+        case 1:  x = _mm_unpackhi_epi8(x, x);      /* byte 15 is word 7 now */
+                 /* fall through */
+        case 2:  x = _mm_shufflehi_epi16(x, 0xFF); /* fall through */
+        default: return _mm_shuffle_epi32(x, 0xFF);
+    }
+}
+
+/* left prediction is a running sum of the residuals along each phase, 16 bytes at once */
+static unsigned int reconstruct_left(unsigned char *cur, unsigned int i, unsigned int n,
+                                     const Layout &layout, const unsigned char *residuals) {
+
+    unsigned int de = layout.left_even;
+    unsigned int dd = layout.left_odd;
+
+    const __m128i odd = _mm_set1_epi16((short) 0xFF00);
+
+    /* the previous output, only its last 4 bytes are used */
+    uint32_t last;
+    memcpy(&last, cur + i - 4, sizeof(last));
+
+    __m128i prev = _mm_set1_epi32((int) last);
+
+    for (; i + 16 <= n; i += 16) {
+
+        __m128i r = unzigzag8(_mm_loadu_si128((const __m128i*) (residuals + i)));
+
+        if (de == dd) {
+            prev = _mm_add_epi8(prefix8(r, de), carry8(prev, de));
+        } else {
+            __m128i even = _mm_add_epi8(prefix8(_mm_andnot_si128(odd, r), de), _mm_andnot_si128(odd, carry8(prev, de)));
+            __m128i oddv = _mm_add_epi8(prefix8(_mm_and_si128(odd, r), dd), _mm_and_si128(odd, carry8(prev, dd)));
+            prev = _mm_or_si128(even, oddv);
+        }
+
+        _mm_storeu_si128((__m128i*) (cur + i), prev);
+    }
+
+    return i;
+}
+
+#endif
+
+/* value at offset (-4 .. 2) from the current group: w are the previous outputs, o the current ones */
+static inline int ring(int offset, int w0, int w1, int w2, int w3, int o0, int o1, int o2) {
+
+    switch (offset) {
+        case -4: return w0;
+        case -3: return w1;
+        case -2: return w2;
+        case -1: return w3;
+        case 0:  return o0;
+        case 1:  return o1;
+        default: return o2;
+    }
+}
+
+/* Paeth is serial along the row, the last outputs are kept in registers instead of reloaded */
+template <unsigned int DE, unsigned int DD>
+static unsigned int reconstruct_paeth(unsigned char *cur, const unsigned char *up, unsigned int i, unsigned int n,
+                                      const unsigned char *residuals) {
+
+    int w0 = cur[i - 4], w1 = cur[i - 3], w2 = cur[i - 2], w3 = cur[i - 1];
+
+    for (; i + 4 <= n; i += 4) {
+
+        int o0 = (unsigned char) (paeth(ring(0 - (int) DE, w0, w1, w2, w3, 0, 0, 0), up[i], up[i - DE]) + unzigzag(residuals[i]));
+        int o1 = (unsigned char) (paeth(ring(1 - (int) DD, w0, w1, w2, w3, o0, 0, 0), up[i + 1], up[i + 1 - DD]) + unzigzag(residuals[i + 1]));
+        int o2 = (unsigned char) (paeth(ring(2 - (int) DE, w0, w1, w2, w3, o0, o1, 0), up[i + 2], up[i + 2 - DE]) + unzigzag(residuals[i + 2]));
+        int o3 = (unsigned char) (paeth(ring(3 - (int) DD, w0, w1, w2, w3, o0, o1, o2), up[i + 3], up[i + 3 - DD]) + unzigzag(residuals[i + 3]));
+
+        cur[i]     = (unsigned char) o0;
+        cur[i + 1] = (unsigned char) o1;
+        cur[i + 2] = (unsigned char) o2;
+        cur[i + 3] = (unsigned char) o3;
+
+        w0 = o0; w1 = o1; w2 = o2; w3 = o3;
+    }
+
+    return i;
+}
+
+/* first position where all the neighbours are within the row */
+#define RECONSTRUCT_HEAD 4
+
+static void reconstruct_row(int mode, unsigned char *cur, const unsigned char *up,
+                            unsigned int n, const Layout &layout, const unsigned char *residuals) {
+
+    unsigned int i  = 0;
+    unsigned int de = layout.left_even;
+    unsigned int dd = layout.left_odd;
+
+    if (up && mode == PRED_UP) {
+
+#if defined(__SSE2__)
+        /* no dependency within the row */
+        for (; i + 16 <= n; i += 16) {
+            __m128i r = unzigzag8(_mm_loadu_si128((const __m128i*) (residuals + i)));
+            _mm_storeu_si128((__m128i*) (cur + i), _mm_add_epi8(_mm_loadu_si128((const __m128i*) (up + i)), r));
+        }
+#endif
+
+        for (; i < n; ++i) {
+            cur[i] = (unsigned char) (up[i] + unzigzag(residuals[i]));
+        }
+        return;
+    }
+
+    for (; i < RECONSTRUCT_HEAD && i < n; ++i) {
+        cur[i] = (unsigned char) (predict(mode, cur, up, i, left_distance(layout, i)) + unzigzag(residuals[i]));
+    }
+
+    if (i == RECONSTRUCT_HEAD) {
+
+        if (!up || mode == PRED_LEFT) {
+#if defined(__SSE2__)
+            i = reconstruct_left(cur, i, n, layout, residuals);
+#else
+            for (; i + 1 < n; i += 2) {
+                cur[i]     = (unsigned char) (cur[i - de] + unzigzag(residuals[i]));
+                cur[i + 1] = (unsigned char) (cur[i + 1 - dd] + unzigzag(residuals[i + 1]));
+            }
+#endif
+        } else {
+            switch (de * 8 + dd) {
+                case 1 * 8 + 1: i = reconstruct_paeth<1, 1>(cur, up, i, n, residuals); break;
+                case 2 * 8 + 2: i = reconstruct_paeth<2, 2>(cur, up, i, n, residuals); break;
+                case 2 * 8 + 4: i = reconstruct_paeth<2, 4>(cur, up, i, n, residuals); break;
+                case 4 * 8 + 2: i = reconstruct_paeth<4, 2>(cur, up, i, n, residuals); break;
+            }
+        }
+    }
+
+    for (; i < n; ++i) {
+        cur[i] = (unsigned char) (predict(mode, cur, up, i, left_distance(layout, i)) + unzigzag(residuals[i]));
+    }
+}
+
+static void decode_band(const unsigned char *payload, size_t size,
+                        unsigned char *frame, unsigned int line_bytes, unsigned int stride,
+                        unsigned int first_row, unsigned int last_row, const Layout &layout) {
+
+    unsigned int rows = last_row - first_row;
+
+    if (size < rows + HUFFMAN_TABLE_SIZE) {
+        throw runtime_error("Corrupted frame: band is truncated");
+    }
+
+    unsigned char lengths[HUFFMAN_SYMBOLS];
+    uint16_t single[1 << HUFFMAN_MAX_BITS];
+    uint32_t table[1 << HUFFMAN_MAX_BITS];
+
+    read_lengths(payload + rows, lengths);
+
+    if (!huffman_table(lengths, single, table) && line_bytes) {
+        throw runtime_error("Corrupted frame: invalid code");
+    }
+
+    vector<unsigned char> residuals(line_bytes + 3);
+
+    BitReader reader = {payload + rows + HUFFMAN_TABLE_SIZE, payload + size, 0, 0, 0};
+
+    for (unsigned int row = first_row; row < last_row; ++row) {
+
+        unsigned char *cur      = frame + (size_t) row * stride;
+        const unsigned char *up = (row - first_row >= layout.up) ? cur - (size_t) layout.up * stride : nullptr;
+
+        int mode = payload[row - first_row];
+
+        if (mode > PRED_PAETH) {
+            throw runtime_error("Corrupted frame: invalid predictor");
+        }
+
+        huffman_decode(reader, single, table, line_bytes, residuals.data());
+
+        reconstruct_row(mode, cur, up, line_bytes, layout, residuals.data());
+    }
+
+    if (reader.overrun()) {
+        throw runtime_error("Corrupted frame: band is truncated");
+    }
+}
+
+bool lossless_geometry(const unsigned char *data, size_t size,
+                       unsigned int &line_bytes, unsigned int &height, unsigned int &pixel_format) {
+
+    StreamHeader header;
+
+    if (size < sizeof(header)) return false;
+
+    memcpy(&header, data, sizeof(header));
+
+    if (header.magic != CODEC_MAGIC) return false;
+
+    line_bytes   = header.line_bytes;
+    height       = header.height;
+    pixel_format = header.pixel_format;
+
+    return true;
+}
+
+void lossless_decode(const unsigned char *data, size_t size,
+                     unsigned char *frame, unsigned int stride, ThreadPool *pool) {
+
+    StreamHeader header;
+
+    if (size < sizeof(header)) {
+        throw runtime_error("Corrupted frame: no header");
+    }
+
+    memcpy(&header, data, sizeof(header));
+
+    if (header.magic != CODEC_MAGIC || header.bands > header.height || (header.bands == 0 && header.height != 0) ||
+            stride < header.line_bytes) {
+        throw runtime_error("Corrupted frame: invalid header");
+    }
+
+    size_t offset = sizeof(header) + header.bands * sizeof(uint32_t);
+
+    if (size < offset) {
+        throw runtime_error("Corrupted frame: no bands table");
+    }
+
+    Layout layout = layout_of(header.pixel_format);
+
+    vector<size_t> band_offset(header.bands);
+    vector<size_t> band_size(header.bands);
+
+    for (unsigned int band = 0; band < header.bands; ++band) {
+
+        uint32_t band_bytes;
+        memcpy(&band_bytes, data + sizeof(header) + band * sizeof(uint32_t), sizeof(band_bytes));
+
+        band_offset[band] = offset;
+        band_size[band]   = band_bytes;
+
+        offset += band_bytes;
+    }
+
+    if (offset > size) {
+        throw runtime_error("Corrupted frame: bands are truncated");
+    }
+
+    auto job = [&](unsigned int band) {
+
+        unsigned int first_row = (unsigned int) ((uint64_t) header.height * band / header.bands);
+        unsigned int last_row  = (unsigned int) ((uint64_t) header.height * (band + 1) / header.bands);
+
+        decode_band(data + band_offset[band], band_size[band], frame,
+                    header.line_bytes, stride, first_row, last_row, layout);
+    };
+
+    if (pool) {
+        pool->parallel(header.bands, job);
+    } else {
+        for (unsigned int band = 0; band < header.bands; ++band) job(band);
+    }
+}
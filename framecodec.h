@@ -0,0 +1,51 @@
+#ifndef FRAMECODEC_H
+#define FRAMECODEC_H
+
+#include <cstddef>
+#include <vector>
+
+#include "threadpool.h"
+
+using namespace std;
+
+/* per-frame codecs */
+#define CODEC_RAW      0
+#define CODEC_LOSSLESS 1
+
+/* number of independently coded bands, the bands are coded in parallel on the pool */
+#define CODEC_BANDS 4
+
+/**
+ * Lossless codec for raw Bayer/YUYV/GREY frames.
+ *
+ * Every row is predicted from the same-phase neighbours (left, up or Paeth,
+ * chosen per row) and the residuals are coded with a canonical Huffman code built per band
+ * (table-driven decoder, up to three symbols per lookup).
+ * The frame is split into horizontal bands coded in parallel on the given pool
+ * (in the caller's thread without pool).
+ */
+
+/**
+ * Encodes line_bytes x height frame, the stream is appended to the output.
+ */
+void lossless_encode(const unsigned char *frame,
+                     unsigned int line_bytes, unsigned int height, unsigned int stride,
+                     unsigned int pixel_format, vector<unsigned char> &output,
+                     unsigned int bands = CODEC_BANDS, ThreadPool *pool = nullptr);
+
+/**
+ * Decodes the stream into the frame with the given stride (at least line_bytes).
+ * Frame geometry is stored in the stream and may be queried with lossless_geometry.
+ * Throws runtime_error if the stream is corrupted.
+ */
+void lossless_decode(const unsigned char *data, size_t size,
+                     unsigned char *frame, unsigned int stride, ThreadPool *pool = nullptr);
+
+/**
+ * Reads geometry of the encoded frame
+ * @return false if the stream is not a lossless frame
+ */
+bool lossless_geometry(const unsigned char *data, size_t size,
+                       unsigned int &line_bytes, unsigned int &height, unsigned int &pixel_format);
+
+#endif // FRAMECODEC_H
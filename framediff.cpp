@@ -0,0 +1,99 @@
+#include <cstring>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "framediff.h"
+
+#define DIFF_BLOCK 16
+
+/* sum of absolute differences of two 16-byte blocks */
+static inline uint32_t block_sad(const unsigned char *a, const unsigned char *b) {
+
+#if defined(__SSE2__)
+    __m128i va  = _mm_loadu_si128((const __m128i*) a);
+    __m128i vb  = _mm_loadu_si128((const __m128i*) b);
+    __m128i sad = _mm_sad_epu8(va, vb); // two 64-bit partial sums
+
+    return (uint32_t) (_mm_cvtsi128_si32(sad) + _mm_cvtsi128_si32(_mm_srli_si128(sad, 8)));
+#elif defined(__ARM_NEON)
+    uint8x16_t diff = vabdq_u8(vld1q_u8(a), vld1q_u8(b));
+    uint64x2_t sum  = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(diff)));
+
+    return (uint32_t) (vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1));
+#else
+    uint32_t sum = 0;
+
+    for (int i = 0; i < DIFF_BLOCK; ++i) {
+        sum += (a[i] > b[i]) ? a[i] - b[i] : b[i] - a[i];
+    }
+
+    return sum;
+#endif
+}
+
+// ========= FrameChangeDetector class ========== //
+
+FrameChangeDetector::FrameChangeDetector(unsigned int row_step, unsigned int block_step) :
+    _row_step(row_step ? row_step : 1),
+    _block_step(block_step < DIFF_BLOCK ? DIFF_BLOCK : block_step),
+    _line_bytes(0), _height(0)
+{
+}
+
+bool FrameChangeDetector::hasReference() const {
+    return !_reference.empty();
+}
+
+double FrameChangeDetector::difference(const unsigned char *frame, unsigned int line_bytes,
+                                       unsigned int height, unsigned int stride) const {
+
+    // geometry has changed, any frame differs
+    if (_reference.empty() || line_bytes != _line_bytes || height != _height) {
+        return 255.0;
+    }
+
+    const unsigned char *ref = _reference.data();
+
+    uint64_t sad = 0;
+
+    for (unsigned int row = 0; row < height; row += _row_step) {
+
+        const unsigned char *line = frame + (size_t) row * stride;
+
+        for (unsigned int col = 0; col + DIFF_BLOCK <= line_bytes; col += _block_step) {
+            sad += block_sad(line + col, ref);
+            ref += DIFF_BLOCK;
+        }
+    }
+
+    return (double) sad / _reference.size();
+}
+
+void FrameChangeDetector::setReference(const unsigned char *frame, unsigned int line_bytes,
+                                       unsigned int height, unsigned int stride) {
+
+    _line_bytes = line_bytes;
+    _height     = height;
+
+    _reference.clear();
+
+    for (unsigned int row = 0; row < height; row += _row_step) {
+
+        const unsigned char *line = frame + (size_t) row * stride;
+
+        for (unsigned int col = 0; col + DIFF_BLOCK <= line_bytes; col += _block_step) {
+            _reference.insert(_reference.end(), line + col, line + col + DIFF_BLOCK);
+        }
+    }
+}
+
+void FrameChangeDetector::reset() {
+    _reference.clear();
+    _line_bytes = 0;
+    _height     = 0;
+}
@@ -0,0 +1,51 @@
+#ifndef FRAMEDIFF_H
+#define FRAMEDIFF_H
+
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+#define DIFF_ROW_STEP   8
+#define DIFF_BLOCK_STEP 64
+
+/**
+ * Cheap change detector for raw frames.
+ *
+ * Only a subsampled grid is inspected: every row_step-th row and, within the row,
+ * 16-byte blocks every block_step bytes. The metric is the mean absolute difference
+ * per sampled byte against the stored reference frame (SSE2/NEON accelerated).
+ */
+class FrameChangeDetector {
+
+public:
+
+    FrameChangeDetector(unsigned int row_step = DIFF_ROW_STEP, unsigned int block_step = DIFF_BLOCK_STEP);
+
+    /* whether a reference frame is stored */
+    bool hasReference() const;
+
+    /* mean absolute difference against the reference, raw frame is line_bytes x height */
+    double difference(const unsigned char *frame, unsigned int line_bytes,
+                      unsigned int height, unsigned int stride) const;
+
+    /* store sampled grid of the frame as a new reference */
+    void setReference(const unsigned char *frame, unsigned int line_bytes,
+                      unsigned int height, unsigned int stride);
+
+    void reset();
+
+private:
+
+    unsigned int _row_step;
+    unsigned int _block_step;
+
+    /* geometry of the stored reference */
+    unsigned int _line_bytes;
+    unsigned int _height;
+
+    /* sampled blocks of the reference frame */
+    vector<unsigned char> _reference;
+};
+
+#endif // FRAMEDIFF_H
@@ -0,0 +1,179 @@
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <stdexcept>
+
+#include "framerecorder.h"
+
+#define RECORD_MAGIC 0x52344c56 // "VL4R"
+
+/**
+ * File layout: file header, then a frame header followed by the payload for each frame
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+} FileHeader;
+
+typedef struct {
+    uint32_t codec;
+    uint32_t line_bytes;
+    uint32_t height;
+    uint32_t pixel_format;
+    uint32_t sequence;
+    uint32_t payload_size;
+    uint64_t timestamp;
+} FrameHeader;
+
+static unsigned int check_codec(unsigned int codec) {
+
+    if (codec != CODEC_RAW && codec != CODEC_LOSSLESS) {
+        throw runtime_error("Unknown codec " + to_string(codec));
+    }
+
+    return codec;
+}
+
+// ========= FrameRecorder class ========== //
+
+FrameRecorder::FrameRecorder(const string &file_name, unsigned int codec, ThreadPool *pool) :
+    _codec(check_codec(codec)), _file(file_name, ios::binary | ios::trunc), _pool(pool), _written_bytes(0), _raw_bytes(0)
+{
+    if (!_file) {
+        throw runtime_error(file_name + ": cannot open! " + strerror(errno));
+    }
+
+    FileHeader header = {RECORD_MAGIC, 1};
+
+    _file.write((const char*) &header, sizeof(header));
+
+    _written_bytes += sizeof(header);
+}
+
+void FrameRecorder::setCodec(unsigned int codec) {
+    _codec = check_codec(codec);
+}
+
+unsigned int FrameRecorder::getCodec() const {
+    return _codec;
+}
+
+void FrameRecorder::write(const unsigned char *frame, unsigned int line_bytes, unsigned int height, unsigned int stride,
+                          unsigned int pixel_format, unsigned int sequence, const struct timeval &timestamp) {
+
+    unsigned int codec = _codec; // the same for the payload and the header
+
+    _payload.clear();
+
+    if (codec == CODEC_LOSSLESS) {
+        lossless_encode(frame, line_bytes, height, stride, pixel_format, _payload, CODEC_BANDS, _pool);
+    } else {
+        // padding is dropped
+        for (unsigned int row = 0; row < height; ++row) {
+            const unsigned char *line = frame + (size_t) row * stride;
+            _payload.insert(_payload.end(), line, line + line_bytes);
+        }
+    }
+
+    FrameHeader header = {0};
+
+    header.codec        = codec;
+    header.line_bytes   = line_bytes;
+    header.height       = height;
+    header.pixel_format = pixel_format;
+    header.sequence     = sequence;
+    header.payload_size = (uint32_t) _payload.size();
+    header.timestamp    = (uint64_t) timestamp.tv_sec * 1000000 + timestamp.tv_usec;
+
+    _file.write((const char*) &header, sizeof(header));
+    _file.write((const char*) _payload.data(), _payload.size());
+
+    if (!_file) {
+        throw runtime_error("Recording write error");
+    }
+
+    _written_bytes += sizeof(header) + _payload.size();
+    _raw_bytes     += (unsigned long long) line_bytes * height;
+}
+
+unsigned long long FrameRecorder::getWrittenBytes() const {
+    return _written_bytes;
+}
+
+unsigned long long FrameRecorder::getRawBytes() const {
+    return _raw_bytes;
+}
+
+// ========= FramePlayer class ========== //
+
+FramePlayer::FramePlayer(const string &file_name, ThreadPool *pool) :
+    _file(file_name, ios::binary), _pool(pool)
+{
+    if (!_file) {
+        throw runtime_error(file_name + ": cannot open! " + strerror(errno));
+    }
+
+    rewind();
+}
+
+void FramePlayer::rewind() {
+
+    _file.clear();
+    _file.seekg(0);
+
+    FileHeader header = {0};
+
+    _file.read((char*) &header, sizeof(header));
+
+    if (!_file || header.magic != RECORD_MAGIC) {
+        throw runtime_error("Not a frame recording");
+    }
+}
+
+bool FramePlayer::read(RecordedFrame &frame) {
+
+    FrameHeader header = {0};
+
+    if (!_file.read((char*) &header, sizeof(header))) {
+        return false; // end of the recording
+    }
+
+    _payload.resize(header.payload_size);
+
+    if (!_file.read((char*) _payload.data(), _payload.size())) {
+        throw runtime_error("Recording is truncated");
+    }
+
+    frame.codec        = header.codec;
+    frame.line_bytes   = header.line_bytes;
+    frame.height       = header.height;
+    frame.pixel_format = header.pixel_format;
+    frame.sequence     = header.sequence;
+    frame.timestamp    = header.timestamp;
+
+    frame.data.resize((size_t) header.line_bytes * header.height);
+
+    switch (header.codec) {
+        case CODEC_RAW:
+            if (_payload.size() != frame.data.size()) {
+                throw runtime_error("Corrupted frame: invalid size");
+            }
+            memcpy(frame.data.data(), _payload.data(), _payload.size());
+            break;
+        case CODEC_LOSSLESS: {
+            unsigned int line_bytes, height, pixel_format;
+
+            if (!lossless_geometry(_payload.data(), _payload.size(), line_bytes, height, pixel_format) ||
+                    line_bytes != header.line_bytes || height != header.height) {
+                throw runtime_error("Corrupted frame: invalid geometry");
+            }
+
+            lossless_decode(_payload.data(), _payload.size(), frame.data.data(), header.line_bytes, _pool);
+            break;
+        }
+        default:
+            throw runtime_error("Unknown codec " + to_string(header.codec));
+    }
+
+    return true;
+}
@@ -0,0 +1,107 @@
+#ifndef FRAMERECORDER_H
+#define FRAMERECORDER_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <atomic>
+#include <sys/time.h>
+
+#include "framecodec.h"
+
+using namespace std;
+
+/**
+ * Recorded frame structure
+ * @param codec        - CODEC_RAW or CODEC_LOSSLESS, chosen per frame
+ * @param line_bytes   - bytes per row of the image (without padding)
+ * @param height       - number of rows
+ * @param pixel_format - V4L2 pixel format
+ * @param sequence     - driver's frame sequence number
+ * @param timestamp    - capture timestamp (in microseconds)
+ * @param data         - raw frame, line_bytes * height bytes without padding (on playback)
+ */
+typedef struct {
+    unsigned int codec;
+    unsigned int line_bytes;
+    unsigned int height;
+    unsigned int pixel_format;
+    unsigned int sequence;
+    unsigned long long timestamp;
+    vector<unsigned char> data;
+} RecordedFrame;
+
+
+/**
+ * Writes raw frames into the recording file, each frame is coded with the current codec.
+ * Bands of the lossless codec are coded on the pool (in the caller's thread without pool).
+ */
+class FrameRecorder {
+
+public:
+
+    FrameRecorder(const string &file_name, unsigned int codec = CODEC_LOSSLESS, ThreadPool *pool = nullptr);
+
+    /* Prohibit copy constructor and assignment operator */
+    FrameRecorder(const FrameRecorder&)            = delete;
+    FrameRecorder& operator=(const FrameRecorder&) = delete;
+
+    /* codec of the next frames, thread safe */
+    void setCodec(unsigned int codec);
+
+    unsigned int getCodec() const;
+
+    void write(const unsigned char *frame, unsigned int line_bytes, unsigned int height, unsigned int stride,
+               unsigned int pixel_format, unsigned int sequence, const struct timeval &timestamp);
+
+    /* bytes written to the file and raw bytes of the recorded frames */
+    unsigned long long getWrittenBytes() const;
+
+    unsigned long long getRawBytes() const;
+
+private:
+
+    /* set from other threads, checked before the file is created */
+    atomic<unsigned int> _codec;
+
+    ofstream _file;
+
+    ThreadPool *_pool;
+
+    /* read from other threads */
+    atomic<unsigned long long> _written_bytes;
+    atomic<unsigned long long> _raw_bytes;
+
+    /* coded frame, reused between frames */
+    vector<unsigned char> _payload;
+};
+
+
+/**
+ * Reads frames from the recording file made by FrameRecorder
+ */
+class FramePlayer {
+
+public:
+
+    FramePlayer(const string &file_name, ThreadPool *pool = nullptr);
+
+    /* Prohibit copy constructor and assignment operator */
+    FramePlayer(const FramePlayer&)            = delete;
+    FramePlayer& operator=(const FramePlayer&) = delete;
+
+    /* reads and decodes the next frame, false at the end of the recording */
+    bool read(RecordedFrame &frame);
+
+    void rewind();
+
+private:
+
+    ifstream _file;
+
+    ThreadPool *_pool;
+
+    vector<unsigned char> _payload;
+};
+
+#endif // FRAMERECORDER_H
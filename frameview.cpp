@@ -0,0 +1,32 @@
+#include "frameview.h"
+#include <QPainter>
+#include <QSurfaceFormat>
+
+FrameView::FrameView(QWidget *parent) :
+  QOpenGLWidget(parent),
+  _image(nullptr)
+{
+  // one swap per vertical blank, the swap blocks until it
+  QSurfaceFormat surface_format = format();
+  surface_format.setSwapInterval(1);
+  setFormat(surface_format);
+}
+
+void FrameView::setImage(const QImage *image) {
+  _image = image;
+}
+
+void FrameView::paintGL() {
+
+  QPainter painter(this);
+
+  if (!_image || _image->isNull()) {
+      painter.fillRect(rect(), Qt::black);
+      painter.setPen(Qt::white);
+      painter.setFont(QFont("Arial", 30));
+      painter.drawText(rect(), Qt::AlignCenter, "Qt");
+      return;
+    }
+
+  painter.drawImage(rect(), *_image);
+}
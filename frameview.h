@@ -0,0 +1,27 @@
+#ifndef FRAMEVIEW_H
+#define FRAMEVIEW_H
+
+#include <QOpenGLWidget>
+#include <QImage>
+
+/**
+ * Paints the presented frame. Rendered with OpenGL, so the window is flushed by
+ * a buffer swap synchronized to the vertical blank (swap interval 1) and
+ * frameSwapped() tells when the next frame may be presented.
+ */
+class FrameView : public QOpenGLWidget
+{
+public:
+  FrameView(QWidget *parent = 0);
+
+  /* the image is owned by the caller, nullptr - no frame yet */
+  void setImage(const QImage *image);
+
+protected:
+  void paintGL();
+
+private:
+  const QImage *_image;
+};
+
+#endif // FRAMEVIEW_H
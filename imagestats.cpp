@@ -0,0 +1,155 @@
+#include <cstring>
+#include <cmath>
+
+#include "imagestats.h"
+
+/* clipped highlights ratio which forces exposure down */
+#define CLIP_HIGH_LIMIT 0.02
+
+/* the largest exposure change per step, keeps the loop stable */
+#define MAX_EXPOSURE_RATIO 2.0
+
+static void luma_statistics(const unsigned char *frame,
+                            unsigned int width, unsigned int height, unsigned int stride,
+                            unsigned int pixel_bytes, unsigned int step,
+                            ImageStatistics &stats, unsigned long long *sum, double &energy) {
+
+    stats.channels = 1;
+
+    for (unsigned int y = 0; y + 1 < height; y += step) {
+
+        const unsigned char *line  = frame + (size_t) y * stride;
+        const unsigned char *below = line + stride;
+
+        for (unsigned int x = 0; x + 1 < width; x += step) {
+
+            int value = line[x * pixel_bytes];
+
+            stats.histogram[0][value]++;
+            sum[0] += value;
+
+            int gx = line[(x + 1) * pixel_bytes] - value;
+            int gy = below[x * pixel_bytes] - value;
+
+            energy += gx * gx + gy * gy;
+
+            stats.samples++;
+        }
+    }
+}
+
+static void bayer_statistics(const unsigned char *frame,
+                             unsigned int width, unsigned int height, unsigned int stride,
+                             unsigned int step,
+                             ImageStatistics &stats, unsigned long long *sum, double &energy) {
+
+    stats.channels = 4;
+
+    /* 2x2 quads are sampled, gradient is taken against the neighbouring quads */
+    for (unsigned int y = 0; y + 3 < height; y += step) {
+
+        const unsigned char *line  = frame + (size_t) y * stride;
+        const unsigned char *below = line + stride;
+        const unsigned char *next  = below + stride;
+        const unsigned char *next2 = next + stride;
+
+        for (unsigned int x = 0; x + 3 < width; x += step) {
+
+            int quad[4] = { line[x], line[x + 1], below[x], below[x + 1] };
+
+            for (int c = 0; c < 4; ++c) {
+                stats.histogram[c][quad[c]]++;
+                sum[c] += quad[c];
+            }
+
+            int level = quad[0] + quad[1] + quad[2] + quad[3];
+            int right = line[x + 2] + line[x + 3] + below[x + 2] + below[x + 3];
+            int down  = next[x] + next[x + 1] + next2[x] + next2[x + 1];
+
+            int gx = (right - level) >> 2;
+            int gy = (down - level) >> 2;
+
+            energy += gx * gx + gy * gy;
+
+            stats.samples++;
+        }
+    }
+}
+
+bool compute_image_statistics(const unsigned char *frame,
+                              unsigned int width, unsigned int height, unsigned int stride,
+                              unsigned int pixel_format, unsigned int step,
+                              ImageStatistics &stats) {
+
+    memset(&stats, 0, sizeof(stats));
+
+    // even step keeps Bayer phases aligned
+    step = (step < 2) ? 2 : (step + 1) & ~1u;
+
+    unsigned long long sum[STATS_CHANNELS] = {0};
+    double energy = 0;
+
+    switch (pixel_format) {
+        case V4L2_PIX_FMT_YUYV:
+            luma_statistics(frame, width, height, stride, 2, step, stats, sum, energy);
+            break;
+        case V4L2_PIX_FMT_GREY:
+            luma_statistics(frame, width, height, stride, 1, step, stats, sum, energy);
+            break;
+        case V4L2_PIX_FMT_SBGGR8:
+        case V4L2_PIX_FMT_SGBRG8:
+        case V4L2_PIX_FMT_SGRBG8:
+        case V4L2_PIX_FMT_SRGGB8:
+            bayer_statistics(frame, width, height, stride, step, stats, sum, energy);
+            break;
+        default:
+            return false;
+    }
+
+    if (stats.samples == 0) return true;
+
+    unsigned long long total = 0;
+    unsigned long long low   = 0;
+    unsigned long long high  = 0;
+
+    for (unsigned int c = 0; c < stats.channels; ++c) {
+
+        stats.mean[c] = (double) sum[c] / stats.samples;
+        total += sum[c];
+
+        for (int bin = 0; bin <= CLIP_LOW; ++bin) low += stats.histogram[c][bin];
+        for (int bin = CLIP_HIGH; bin < STATS_BINS; ++bin) high += stats.histogram[c][bin];
+    }
+
+    double values = (double) stats.samples * stats.channels;
+
+    stats.mean_level   = total / values;
+    stats.clipped_low  = low / values;
+    stats.clipped_high = high / values;
+    stats.focus        = energy / stats.samples;
+
+    return true;
+}
+
+int suggest_exposure(const ImageStatistics &stats, int current_exposure,
+                     double target_level, int min_exposure, int max_exposure) {
+
+    if (stats.samples == 0) return current_exposure;
+
+    double level = (stats.mean_level < 1.0) ? 1.0 : stats.mean_level;
+    double ratio = target_level / level;
+
+    // do not brighten the image when highlights are already blown
+    if (stats.clipped_high > CLIP_HIGH_LIMIT && ratio > 0.9) {
+        ratio = 0.9;
+    }
+
+    ratio = fmin(fmax(ratio, 1.0 / MAX_EXPOSURE_RATIO), MAX_EXPOSURE_RATIO);
+
+    long exposure = lround(current_exposure * ratio);
+
+    if (exposure < min_exposure) exposure = min_exposure;
+    if (exposure > max_exposure) exposure = max_exposure;
+
+    return (int) exposure;
+}
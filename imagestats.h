@@ -0,0 +1,56 @@
+#ifndef IMAGESTATS_H
+#define IMAGESTATS_H
+
+#include <linux/videodev2.h>
+
+#define STATS_CHANNELS 4
+#define STATS_BINS     256
+
+#define STATS_STEP 4
+
+/* values at or beyond these levels are counted as clipped */
+#define CLIP_LOW  2
+#define CLIP_HIGH 253
+
+/**
+ * Per-frame image statistics, computed on a subsampled raw frame
+ * @param channels     - 1 for luma (YUYV, GREY), 4 for Bayer (raw 2x2 phase order: row-major)
+ * @param samples      - number of sampled pixels per channel (0 if not computed)
+ * @param histogram    - per-channel histograms
+ * @param mean         - per-channel mean value
+ * @param mean_level   - mean over all channels
+ * @param clipped_low  - ratio of samples <= CLIP_LOW
+ * @param clipped_high - ratio of samples >= CLIP_HIGH
+ * @param focus        - gradient energy (mean squared luma gradient), higher is sharper
+ */
+typedef struct {
+    unsigned int channels;
+    unsigned int samples;
+    unsigned int histogram[STATS_CHANNELS][STATS_BINS];
+    double mean[STATS_CHANNELS];
+    double mean_level;
+    double clipped_low;
+    double clipped_high;
+    double focus;
+} ImageStatistics;
+
+
+/**
+ * Computes statistics of the raw frame in a single subsampled pass,
+ * every step-th pixel of every step-th row is sampled (step is rounded up to even).
+ * Supported formats: YUYV, GREY and 8-bit Bayer.
+ * @return false if the pixel format is not supported
+ */
+bool compute_image_statistics(const unsigned char *frame,
+                              unsigned int width, unsigned int height, unsigned int stride,
+                              unsigned int pixel_format, unsigned int step,
+                              ImageStatistics &stats);
+
+/**
+ * Proportional exposure correction towards the target mean level,
+ * highlights clipping forces exposure down. Result can be passed to V4L2_CID_EXPOSURE_ABSOLUTE.
+ */
+int suggest_exposure(const ImageStatistics &stats, int current_exposure,
+                     double target_level = 110.0, int min_exposure = 1, int max_exposure = 10000);
+
+#endif // IMAGESTATS_H
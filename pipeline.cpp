@@ -0,0 +1,200 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include <stdexcept>
+
+#include "pipeline.h"
+
+// ========= Pipeline class ========== //
+
+Pipeline::Stage::Stage(const string &name, const StageFunction &function,
+                       BackpressurePolicy policy, unsigned int capacity) :
+    name(name), function(function), policy(policy), input(capacity), state(STAGE_IDLE),
+    processed(0), dropped(0), failed(0), total_ns(0), max_ns(0)
+{
+}
+
+Pipeline::Pipeline(ThreadPool &pool) :
+    _pool(pool), _stopping(false), _active_tasks(0)
+{
+}
+
+Pipeline::~Pipeline() {
+
+    _stopping = true;
+
+    // tasks on the pool refer to the stages
+    while (_active_tasks) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+}
+
+int Pipeline::addStage(const string &name, const StageFunction &function, int parent,
+                       BackpressurePolicy policy, unsigned int capacity) {
+
+    if (parent != PIPELINE_SOURCE && (parent < 0 || parent >= (int) _stages.size())) {
+        throw runtime_error("Invalid parent stage " + to_string(parent));
+    }
+
+    _stages.push_back(unique_ptr<Stage>(new Stage(name, function, policy, capacity)));
+
+    Stage *stage = _stages.back().get();
+
+    if (parent == PIPELINE_SOURCE) {
+        _sources.push_back(stage);
+    } else {
+        _stages[parent]->children.push_back(stage);
+    }
+
+    return (int) _stages.size() - 1;
+}
+
+void Pipeline::push(const FramePtr &frame) {
+
+    if (_stopping) return;
+
+    for (auto stage : _sources) {
+        deliver(*stage, frame);
+    }
+}
+
+void Pipeline::deliver(Stage &stage, const FramePtr &frame) {
+
+    switch (stage.policy) {
+
+        case DROP_NEWEST:
+            if (!stage.input.tryPush(frame)) {
+                stage.dropped++;
+                return;
+            }
+            break;
+
+        case DROP_OLDEST:
+            while (!stage.input.tryPush(frame)) {
+                FramePtr oldest;
+                if (stage.input.tryPop(oldest)) stage.dropped++;
+            }
+            break;
+
+        case BLOCK:
+            while (!stage.input.tryPush(frame)) {
+
+                if (_stopping) {
+                    stage.dropped++;
+                    return;
+                }
+
+                /*
+                 * run the consumer instead of waiting for a pool thread, its task may be
+                 * queued behind the producer itself
+                 */
+                if (claim(stage, STAGE_IDLE) || claim(stage, STAGE_QUEUED)) {
+                    _active_tasks++;
+                    run(stage);
+                    _active_tasks--;
+                } else {
+                    this_thread::yield(); // running in another thread
+                }
+            }
+            break;
+    }
+
+    /*
+     * the push must be visible before the state is read, pairs with the fence in run:
+     * either the runner sees the frame or the producer sees STAGE_IDLE
+     * (the queue positions are relaxed, a CAS on the state alone doesn't order them)
+     */
+    atomic_thread_fence(memory_order_seq_cst);
+
+    schedule(stage);
+}
+
+void Pipeline::schedule(Stage &stage) {
+
+    int idle = STAGE_IDLE;
+
+    if (!stage.state.compare_exchange_strong(idle, STAGE_QUEUED)) return; // already queued or running
+
+    _active_tasks++;
+
+    _pool.submit([this, &stage]() {
+        // the stage may have been run by a blocked producer meanwhile
+        if (claim(stage, STAGE_QUEUED)) run(stage);
+        _active_tasks--;
+    });
+}
+
+bool Pipeline::claim(Stage &stage, int state) {
+    return stage.state.compare_exchange_strong(state, STAGE_RUNNING);
+}
+
+void Pipeline::run(Stage &stage) {
+
+    while (true) {
+
+        FramePtr frame;
+
+        while (stage.input.tryPop(frame)) {
+            if (!_stopping) process(stage, frame);
+        }
+
+        stage.state = STAGE_IDLE;
+
+        // a frame might have been pushed after the last pop, see the fence in deliver
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if (stage.input.size() == 0 || !claim(stage, STAGE_IDLE)) break;
+    }
+}
+
+void Pipeline::process(Stage &stage, const FramePtr &frame) {
+
+    auto start = chrono::steady_clock::now();
+
+    FramePtr result;
+
+    try {
+        result = stage.function(frame);
+    } catch (const exception &e) {
+        stage.failed++;
+        cerr << "Stage " << stage.name << ": " << e.what() << endl;
+    }
+
+    unsigned long long ns = (unsigned long long)
+            chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+
+    stage.processed++;
+    stage.total_ns += ns;
+
+    if (ns > stage.max_ns) stage.max_ns = ns;
+
+    if (!result) return;
+
+    // children share the result
+    for (auto child : stage.children) {
+        deliver(*child, result);
+    }
+}
+
+vector<stage_stats> Pipeline::getStatistics() const {
+
+    vector<stage_stats> statistics;
+
+    for (auto &stage : _stages) {
+
+        stage_stats stats;
+
+        stats.name      = stage->name;
+        stats.processed = stage->processed;
+        stats.dropped   = stage->dropped;
+        stats.failed    = stage->failed;
+        stats.queued    = (unsigned int) stage->input.size();
+        stats.avg_ms    = stats.processed ? stage->total_ns / 1e6 / stats.processed : 0.0;
+        stats.max_ms    = stage->max_ns / 1e6;
+
+        statistics.push_back(stats);
+    }
+
+    return statistics;
+}
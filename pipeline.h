@@ -0,0 +1,152 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <sys/time.h>
+
+#include "boundedqueue.h"
+#include "threadpool.h"
+#include "imagestats.h"
+
+using namespace std;
+
+/* parent of the stages fed directly by Pipeline::push */
+#define PIPELINE_SOURCE -1
+
+#define QUEUE_CAPACITY 4
+
+/* stage states: not scheduled, task waits on the pool, running (on the pool or in a blocked producer) */
+#define STAGE_IDLE    0
+#define STAGE_QUEUED  1
+#define STAGE_RUNNING 2
+
+/**
+ * What to do when the input queue of a stage is full
+ * BLOCK       - producer waits (and helps by running the stage itself)
+ * DROP_OLDEST - the oldest queued frame is dropped
+ * DROP_NEWEST - the incoming frame is dropped
+ */
+enum BackpressurePolicy { BLOCK, DROP_OLDEST, DROP_NEWEST };
+
+/**
+ * Frame passed between the stages. Frames are immutable and shared by all consumers,
+ * a stage which only adds metadata reuses the data of its input.
+ * data points to the first pixel, rows are stride bytes apart; it's owned by
+ * a copy or by a capture buffer held until the last reference is dropped.
+ */
+typedef struct {
+    unsigned int width;
+    unsigned int height;
+    unsigned int stride;
+    unsigned int pixel_format;
+    unsigned int sequence;
+    struct timeval timestamp;
+    bool timestamp_monotonic; // the timestamp is CLOCK_MONOTONIC, latency may be measured
+    shared_ptr<const unsigned char> data;
+    shared_ptr<const ImageStatistics> stats;
+} Frame;
+
+typedef shared_ptr<const Frame> FramePtr;
+
+/* processes the frame, result is passed to the child stages (nullptr - nothing to pass) */
+typedef function<FramePtr(const FramePtr&)> StageFunction;
+
+/**
+ * Stage statistics structure
+ * @param name      - stage name
+ * @param processed - frames processed by the stage
+ * @param dropped   - frames dropped on the stage input by backpressure
+ * @param failed    - frames the stage failed on (exception)
+ * @param queued    - frames waiting in the input queue
+ * @param avg_ms    - average processing time
+ * @param max_ms    - maximal processing time
+ */
+typedef struct {
+    string name;
+    unsigned long long processed;
+    unsigned long long dropped;
+    unsigned long long failed;
+    unsigned int queued;
+    double avg_ms;
+    double max_ms;
+} stage_stats;
+
+
+/**
+ * Graph of processing stages connected by bounded lock-free queues, run on a shared thread pool.
+ * A stage never runs concurrently with itself, so stage functions need no locking
+ * and see frames in order. Stages are added before the first push.
+ */
+class Pipeline {
+
+public:
+
+    Pipeline(ThreadPool &pool);
+
+    /* waits for the running stages */
+    ~Pipeline();
+
+    /* Prohibit copy constructor and assignment operator */
+    Pipeline(const Pipeline&)            = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    /* adds stage fed by the parent stage, returns stage's id */
+    int addStage(const string &name, const StageFunction &function, int parent = PIPELINE_SOURCE,
+                 BackpressurePolicy policy = DROP_OLDEST, unsigned int capacity = QUEUE_CAPACITY);
+
+    /* passes the frame to the source stages */
+    void push(const FramePtr &frame);
+
+    vector<stage_stats> getStatistics() const;
+
+private:
+
+    struct Stage {
+
+        Stage(const string &name, const StageFunction &function, BackpressurePolicy policy, unsigned int capacity);
+
+        string name;
+        StageFunction function;
+        BackpressurePolicy policy;
+
+        BoundedQueue<FramePtr> input;
+
+        vector<Stage*> children;
+
+        /* STAGE_IDLE, STAGE_QUEUED or STAGE_RUNNING */
+        atomic<int> state;
+
+        /* counters, thread safe */
+        atomic<unsigned long long> processed;
+        atomic<unsigned long long> dropped;
+        atomic<unsigned long long> failed;
+        atomic<unsigned long long> total_ns;
+        atomic<unsigned long long> max_ns;
+    };
+
+    ThreadPool &_pool;
+
+    vector<unique_ptr<Stage>> _stages;
+    vector<Stage*> _sources;
+
+    atomic<bool> _stopping;
+    atomic<unsigned int> _active_tasks;
+
+    void deliver(Stage&, const FramePtr&);
+
+    void schedule(Stage&);
+
+    /* changes the state from the given one to STAGE_RUNNING */
+    bool claim(Stage&, int state);
+
+    /* runs the claimed stage until its queue is empty */
+    void run(Stage&);
+
+    void process(Stage&, const FramePtr&);
+};
+
+#endif // PIPELINE_H
@@ -0,0 +1,157 @@
+#include <cstring>
+
+#include "pipelinestages.h"
+#include "v4l2convert.h"
+
+static bool is_bayer(unsigned int pixel_format) {
+    return pixel_format == V4L2_PIX_FMT_SBGGR8 || pixel_format == V4L2_PIX_FMT_SGBRG8 ||
+           pixel_format == V4L2_PIX_FMT_SGRBG8 || pixel_format == V4L2_PIX_FMT_SRGGB8;
+}
+
+/* bytes per row of the image without padding */
+static unsigned int line_bytes(const Frame &frame) {
+    return frame.width * v4lconvert_pixel_bytes(frame.pixel_format);
+}
+
+/* frame data owned by the vector */
+static shared_ptr<const unsigned char> share(const shared_ptr<vector<unsigned char>> &bytes) {
+    return shared_ptr<const unsigned char>(bytes, bytes->data());
+}
+
+FramePtr make_frame(V4L2Device &device, const Buffer &buffer, const struct v4l2_buffer &buffer_info) {
+
+    shared_ptr<Frame> frame = make_shared<Frame>();
+
+    frame->width        = buffer.width;
+    frame->height       = buffer.height;
+    frame->pixel_format = device.getFormat().fmt.pix.pixelformat;
+    frame->sequence     = buffer_info.sequence;
+    frame->timestamp    = buffer_info.timestamp;
+
+    frame->timestamp_monotonic = (buffer_info.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+
+    if (buffer.stats.samples) { // computed by the device
+        frame->stats = make_shared<ImageStatistics>(buffer.stats);
+    }
+
+    /* no copy: the capture buffer goes back to the pool when the last consumer drops the frame */
+    if (device.holdBuffer(buffer)) {
+
+        V4L2Device *owner = &device;
+        unsigned int index = buffer.index; // Buffer is too big to be captured, it embeds the statistics
+
+        frame->stride = buffer.stride;
+        frame->data   = shared_ptr<const unsigned char>((const unsigned char*) buffer.image,
+                                                        [owner, index](const unsigned char*) {
+            owner->releaseBuffer(index);
+        });
+
+        return frame;
+    }
+
+    // only the region of interest is copied, its rows become contiguous
+    frame->stride = line_bytes(*frame);
+
+    shared_ptr<vector<unsigned char>> data = make_shared<vector<unsigned char>>((size_t) frame->stride * frame->height);
+
+    for (unsigned int y = 0; y < frame->height; ++y) {
+        memcpy(data->data() + (size_t) y * frame->stride,
+               (const unsigned char*) buffer.image + (size_t) y * buffer.stride, frame->stride);
+    }
+
+    frame->data = share(data);
+
+    return frame;
+}
+
+StageFunction make_convert_stage() {
+
+    return [](const FramePtr &input) -> FramePtr {
+
+        bool yuyv = input->pixel_format == V4L2_PIX_FMT_YUYV;
+
+        if (!yuyv && !is_bayer(input->pixel_format)) return input;
+
+        shared_ptr<Frame> output = make_shared<Frame>(*input);
+        shared_ptr<vector<unsigned char>> rgb = make_shared<vector<unsigned char>>((size_t) input->width * input->height * 3);
+
+        if (yuyv) {
+            v4lconvert_yuyv_to_rgb24(input->data.get(), rgb->data(),
+                                     input->width, input->height, input->stride);
+        } else {
+            v4lconvert_bayer_to_rgb24(input->data.get(), rgb->data(),
+                                      input->width, input->height, input->stride, input->pixel_format);
+        }
+
+        output->pixel_format = V4L2_PIX_FMT_RGB24;
+        output->stride       = input->width * 3;
+        output->data         = share(rgb);
+
+        return output;
+    };
+}
+
+StageFunction make_scale_stage(unsigned int factor) {
+
+    if (factor == 0) factor = 1;
+
+    return [factor](const FramePtr &input) -> FramePtr {
+
+        if (input->pixel_format != V4L2_PIX_FMT_RGB24 || factor == 1) return input;
+
+        shared_ptr<Frame> output = make_shared<Frame>(*input);
+
+        output->width  = input->width / factor;
+        output->height = input->height / factor;
+        output->stride = output->width * 3;
+
+        shared_ptr<vector<unsigned char>> rgb = make_shared<vector<unsigned char>>((size_t) output->stride * output->height);
+
+        for (unsigned int y = 0; y < output->height; ++y) {
+
+            const unsigned char *source = input->data.get() + (size_t) y * factor * input->stride;
+            unsigned char *dest = rgb->data() + (size_t) y * output->stride;
+
+            for (unsigned int x = 0; x < output->width; ++x) {
+                const unsigned char *pixel = source + x * factor * 3;
+                *dest++ = pixel[0];
+                *dest++ = pixel[1];
+                *dest++ = pixel[2];
+            }
+        }
+
+        output->data = share(rgb);
+
+        return output;
+    };
+}
+
+StageFunction make_stats_stage(unsigned int step) {
+
+    return [step](const FramePtr &input) -> FramePtr {
+
+        shared_ptr<ImageStatistics> stats = make_shared<ImageStatistics>();
+
+        if (!compute_image_statistics(input->data.get(), input->width, input->height, input->stride,
+                                      input->pixel_format, step, *stats)) {
+            return input; // format is not supported
+        }
+
+        shared_ptr<Frame> output = make_shared<Frame>(*input);
+
+        output->stats = stats;
+
+        return output;
+    };
+}
+
+StageFunction make_record_stage(const shared_ptr<FrameRecorder> &recorder) {
+
+    return [recorder](const FramePtr &input) -> FramePtr {
+
+        recorder->write(input->data.get(), line_bytes(*input), input->height, input->stride,
+                        input->pixel_format, input->sequence, input->timestamp);
+
+        return input;
+    };
+}
@@ -0,0 +1,32 @@
+#ifndef PIPELINESTAGES_H
+#define PIPELINESTAGES_H
+
+#include <memory>
+
+#include "pipeline.h"
+#include "v4l2device.h"
+#include "framerecorder.h"
+
+/*
+ * Common pipeline stages
+ */
+
+/*
+ * wraps the captured buffer into a new frame: the buffer is held by the frame if the device allows it
+ * (a spare buffer is free), otherwise it's copied and may be requeued afterwards
+ */
+FramePtr make_frame(V4L2Device &device, const Buffer &buffer, const struct v4l2_buffer &buffer_info);
+
+/* YUYV/Bayer to RGB24 (V4L2_PIX_FMT_RGB24), other formats are passed as is */
+StageFunction make_convert_stage();
+
+/* RGB24 downscaling by an integer factor (nearest neighbour) */
+StageFunction make_scale_stage(unsigned int factor);
+
+/* attaches image statistics, the frame data is shared with the input */
+StageFunction make_stats_stage(unsigned int step = STATS_STEP);
+
+/* writes the frame to the recording and passes it on */
+StageFunction make_record_stage(const shared_ptr<FrameRecorder> &recorder);
+
+#endif // PIPELINESTAGES_H
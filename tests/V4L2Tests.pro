@@ -0,0 +1,35 @@
+#-------------------------------------------------
+#
+# Tests of the capture core, no Qt and no OpenCV
+#
+#-------------------------------------------------
+
+TARGET = V4L2Tests
+TEMPLATE = app
+
+CONFIG  += console c++11
+CONFIG  -= qt app_bundle
+
+QMAKE_CXXFLAGS += -Wall -Wextra -pedantic
+
+LIBS += -pthread
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    main.cpp \
+    codectest.cpp \
+    pipelinetest.cpp \
+    recordertest.cpp \
+    ../framecodec.cpp \
+    ../framerecorder.cpp \
+    ../threadpool.cpp \
+    ../pipeline.cpp
+
+HEADERS += \
+    tests.h \
+    ../framecodec.h \
+    ../framerecorder.h \
+    ../threadpool.h \
+    ../boundedqueue.h \
+    ../pipeline.h
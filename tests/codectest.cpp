@@ -0,0 +1,226 @@
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include <linux/videodev2.h>
+
+#include "tests.h"
+#include "framecodec.h"
+#include "threadpool.h"
+
+/* frame with the rows stride bytes apart, the padding is filled to catch reads past line_bytes */
+typedef struct {
+    unsigned int line_bytes;
+    unsigned int height;
+    unsigned int stride;
+    vector<unsigned char> data;
+} TestFrame;
+
+static TestFrame make_frame(unsigned int line_bytes, unsigned int height, unsigned int padding) {
+    return TestFrame{line_bytes, height, line_bytes + padding,
+                     vector<unsigned char>((size_t) (line_bytes + padding) * height, 0xa5)};
+}
+
+/* smooth gradient with some noise, typical sensor data */
+static TestFrame gradient_frame(unsigned int line_bytes, unsigned int height, unsigned int padding,
+                                int noise, mt19937 &random) {
+
+    TestFrame frame = make_frame(line_bytes, height, padding);
+    uniform_int_distribution<int> distribution(-noise, noise);
+
+    for (unsigned int y = 0; y < height; ++y) {
+        for (unsigned int x = 0; x < line_bytes; ++x) {
+            int value = (int) (x * 3 + y * 2 + (x & 1) * 40 + (y & 1) * 20) + distribution(random);
+            frame.data[(size_t) y * frame.stride + x] = (unsigned char) value;
+        }
+    }
+
+    return frame;
+}
+
+static TestFrame noise_frame(unsigned int line_bytes, unsigned int height, mt19937 &random) {
+
+    TestFrame frame = make_frame(line_bytes, height, 0);
+
+    for (unsigned char &value : frame.data) value = (unsigned char) random();
+
+    return frame;
+}
+
+/*
+ * Residuals with geometric distribution (each value half as likely as the previous one),
+ * the optimal code is longer than HUFFMAN_MAX_BITS so the lengths have to be limited
+ */
+static TestFrame geometric_frame(unsigned int line_bytes, unsigned int height, mt19937 &random) {
+
+    TestFrame frame = make_frame(line_bytes, height, 0);
+    geometric_distribution<int> distribution(0.5);
+
+    for (unsigned int y = 0; y < height; ++y) {
+
+        unsigned char value = 0;
+
+        for (unsigned int x = 0; x < line_bytes; ++x) {
+            value = (unsigned char) (value + min(distribution(random), 255));
+            frame.data[(size_t) y * line_bytes + x] = value;
+        }
+    }
+
+    return frame;
+}
+
+static bool same_pixels(const TestFrame &a, const TestFrame &b) {
+
+    if (a.line_bytes == 0) return true;
+
+    for (unsigned int y = 0; y < a.height; ++y) {
+        if (memcmp(a.data.data() + (size_t) y * a.stride, b.data.data() + (size_t) y * b.stride, a.line_bytes)) return false;
+    }
+
+    return true;
+}
+
+static vector<unsigned char> encode(const TestFrame &frame, unsigned int pixel_format,
+                                    unsigned int bands = CODEC_BANDS, ThreadPool *pool = nullptr) {
+
+    vector<unsigned char> stream;
+    lossless_encode(frame.data.data(), frame.line_bytes, frame.height, frame.stride,
+                    pixel_format, stream, bands, pool);
+
+    return stream;
+}
+
+static bool round_trip(const TestFrame &frame, unsigned int pixel_format,
+                       unsigned int bands = CODEC_BANDS, ThreadPool *pool = nullptr,
+                       unsigned int padding = 0) {
+
+    vector<unsigned char> stream = encode(frame, pixel_format, bands, pool);
+
+    unsigned int line_bytes, height, format;
+
+    if (!lossless_geometry(stream.data(), stream.size(), line_bytes, height, format)) return false;
+    if (line_bytes != frame.line_bytes || height != frame.height || format != pixel_format) return false;
+
+    TestFrame decoded = make_frame(line_bytes, height, padding);
+    lossless_decode(stream.data(), stream.size(), decoded.data.data(), decoded.stride, pool);
+
+    return same_pixels(frame, decoded);
+}
+
+static bool throws(const vector<unsigned char> &stream, size_t size, unsigned int line_bytes, unsigned int height) {
+
+    vector<unsigned char> frame((size_t) line_bytes * height);
+
+    try {
+        lossless_decode(stream.data(), size, frame.data(), line_bytes);
+    } catch (const runtime_error&) {
+        return true;
+    }
+
+    return false;
+}
+
+void codec_tests() {
+
+    mt19937 random(20261019);
+    ThreadPool pool(3);
+
+    const unsigned int formats[] = {V4L2_PIX_FMT_SGRBG8, V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_UYVY, V4L2_PIX_FMT_GREY};
+
+    /* all formats and predictors, odd sizes, padded source and destination rows */
+    for (unsigned int format : formats) {
+
+        CHECK(round_trip(gradient_frame(640, 48, 0, 2, random), format));
+        CHECK(round_trip(gradient_frame(333, 37, 11, 6, random), format, CODEC_BANDS, nullptr, 5));
+        CHECK(round_trip(gradient_frame(1282, 21, 64, 30, random), format, CODEC_BANDS, &pool, 3));
+    }
+
+    /* band splits, including more bands than rows */
+    for (unsigned int bands = 0; bands <= 5; ++bands) {
+        CHECK(round_trip(gradient_frame(200, 7, 0, 4, random), V4L2_PIX_FMT_SGRBG8, bands));
+        CHECK(round_trip(gradient_frame(200, 7, 0, 4, random), V4L2_PIX_FMT_SGRBG8, bands, &pool));
+    }
+
+    CHECK(round_trip(gradient_frame(64, 3, 0, 4, random), V4L2_PIX_FMT_YUYV, 8, &pool));
+
+    /* the pool and the caller's thread produce the same stream */
+    {
+        TestFrame frame = gradient_frame(517, 61, 3, 8, random);
+        CHECK(encode(frame, V4L2_PIX_FMT_SGRBG8, 4) == encode(frame, V4L2_PIX_FMT_SGRBG8, 4, &pool));
+    }
+
+    /* constant frame: two symbols (the first byte and the zero residuals), one bit codes */
+    {
+        TestFrame frame = make_frame(320, 16, 0);
+        memset(frame.data.data(), 77, frame.data.size());
+        CHECK(round_trip(frame, V4L2_PIX_FMT_GREY, 1));
+        CHECK(encode(frame, V4L2_PIX_FMT_GREY, 1).size() < 320 * 16 / 6);
+    }
+
+    /* black frame: a single symbol, zero length code */
+    {
+        TestFrame frame = make_frame(320, 16, 0);
+        memset(frame.data.data(), 0, frame.data.size());
+        CHECK(round_trip(frame, V4L2_PIX_FMT_SGRBG8, 2, &pool));
+    }
+
+    /* incompressible data: all 256 symbols, longest codes */
+    CHECK(round_trip(noise_frame(777, 19, random), V4L2_PIX_FMT_SGRBG8));
+    CHECK(round_trip(noise_frame(777, 19, random), V4L2_PIX_FMT_GREY, 2, &pool));
+
+    /* code lengths above the limit, the bit reader/writer stay in sync with the limited code */
+    CHECK(round_trip(geometric_frame(4096, 16, random), V4L2_PIX_FMT_GREY, 1));
+    CHECK(round_trip(geometric_frame(1001, 9, random), V4L2_PIX_FMT_GREY, 3));
+
+    /* empty frames */
+    CHECK(round_trip(make_frame(0, 0, 0), V4L2_PIX_FMT_GREY));
+    CHECK(round_trip(make_frame(64, 0, 0), V4L2_PIX_FMT_SGRBG8, CODEC_BANDS, &pool));
+    CHECK(round_trip(make_frame(0, 5, 0), V4L2_PIX_FMT_YUYV));
+
+    /* tiny frames, shorter than a bit reader refill */
+    CHECK(round_trip(gradient_frame(1, 1, 0, 0, random), V4L2_PIX_FMT_GREY));
+    CHECK(round_trip(gradient_frame(3, 1, 0, 1, random), V4L2_PIX_FMT_GREY));
+    CHECK(round_trip(gradient_frame(2, 3, 0, 1, random), V4L2_PIX_FMT_YUYV));
+    CHECK(round_trip(noise_frame(5, 2, random), V4L2_PIX_FMT_SGRBG8));
+
+    /* corrupted streams */
+    {
+        TestFrame frame = gradient_frame(256, 32, 0, 8, random);
+        vector<unsigned char> stream = encode(frame, V4L2_PIX_FMT_SGRBG8);
+        unsigned int line_bytes, height, format;
+
+        CHECK(!lossless_geometry(stream.data(), 4, line_bytes, height, format));
+        CHECK(throws(stream, 8, 256, 32));
+        CHECK(throws(stream, 30, 256, 32));
+        CHECK(throws(stream, stream.size() - 1, 256, 32));
+
+        vector<unsigned char> bad_magic = stream;
+        bad_magic[0] ^= 0xff;
+        CHECK(!lossless_geometry(bad_magic.data(), bad_magic.size(), line_bytes, height, format));
+        CHECK(throws(bad_magic, bad_magic.size(), 256, 32));
+
+        /* destination rows shorter than the frame's */
+        vector<unsigned char> decoded(256 * 32);
+        bool rejected = false;
+        try {
+            lossless_decode(stream.data(), stream.size(), decoded.data(), 255);
+        } catch (const runtime_error&) {
+            rejected = true;
+        }
+        CHECK(rejected);
+
+        /* random damage must be either detected or decoded without touching memory out of the frame */
+        for (unsigned int i = 0; i < 200; ++i) {
+
+            vector<unsigned char> damaged = stream;
+            damaged[sizeof(uint32_t) * 5 + random() % (damaged.size() - sizeof(uint32_t) * 5)] ^= 1 << (random() % 8);
+
+            try {
+                lossless_decode(damaged.data(), damaged.size(), decoded.data(), 256);
+            } catch (const runtime_error&) {
+            }
+        }
+    }
+}
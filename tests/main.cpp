@@ -0,0 +1,44 @@
+#include <cstdio>
+#include <exception>
+
+#include "tests.h"
+
+static unsigned int checks   = 0;
+static unsigned int failures = 0;
+
+bool check_condition(bool passed, const char *condition, const char *file, int line) {
+
+    checks++;
+
+    if (!passed) {
+        failures++;
+        printf("FAILED %s:%d: %s\n", file, line, condition);
+    }
+
+    return passed;
+}
+
+static void run(const char *name, void (*suite)()) {
+
+    unsigned int failed = failures;
+
+    try {
+        suite();
+    } catch (const exception &e) {
+        failures++;
+        printf("FAILED %s: %s\n", name, e.what());
+    }
+
+    printf("%-10s %s\n", name, failures == failed ? "passed" : "FAILED");
+}
+
+int main() {
+
+    run("codec", codec_tests);
+    run("pipeline", pipeline_tests);
+    run("recorder", recorder_tests);
+
+    printf("%u checks, %u failed\n", checks, failures);
+
+    return failures ? 1 : 0;
+}
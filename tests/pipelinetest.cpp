@@ -0,0 +1,198 @@
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <unistd.h>
+
+#include "tests.h"
+#include "pipeline.h"
+#include "threadpool.h"
+
+#define TIMEOUT_MS 5000
+
+static FramePtr make_frame(unsigned int sequence) {
+
+    shared_ptr<Frame> frame = make_shared<Frame>();
+    frame->sequence = sequence;
+
+    return frame;
+}
+
+/* waits until the condition holds, false on timeout */
+template <typename Condition>
+static bool wait_for(Condition condition) {
+
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(TIMEOUT_MS);
+
+    while (!condition()) {
+        if (chrono::steady_clock::now() > deadline) return false;
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+
+    return true;
+}
+
+/* a deadlocked pipeline can't be destroyed, the run is aborted */
+static void check_progress(bool progress, const char *test) {
+
+    if (!CHECK(progress)) {
+        printf("%s: pipeline is stuck\n", test);
+        fflush(stdout);
+        _exit(1);
+    }
+}
+
+/* occupies a pool thread until released */
+static void block_pool(ThreadPool &pool, atomic<bool> &release) {
+
+    atomic<bool> started(false);
+
+    pool.submit([&started, &release]() {
+        started = true;
+        while (!release) this_thread::sleep_for(chrono::milliseconds(1));
+    });
+
+    while (!started) this_thread::yield();
+}
+
+/*
+ * Single pool thread: the BLOCK consumer's task is queued behind the producer stage,
+ * the producer has to run it instead of waiting for it
+ */
+static void block_behind_producer() {
+
+    ThreadPool pool(1);
+    Pipeline pipeline(pool);
+
+    atomic<unsigned int> produced(0), consumed(0);
+    atomic<bool> ordered(true);
+    unsigned int expected = 0;
+
+    int producer = pipeline.addStage("producer", [&](const FramePtr &frame) {
+        produced++;
+        return frame;
+    }, PIPELINE_SOURCE, DROP_NEWEST, 64);
+
+    pipeline.addStage("consumer", [&](const FramePtr &frame) {
+        if (frame->sequence != expected++) ordered = false;
+        consumed++;
+        return FramePtr();
+    }, producer, BLOCK, 2);
+
+    for (unsigned int i = 0; i < 64; ++i) pipeline.push(make_frame(i));
+
+    check_progress(wait_for([&]() { return consumed == 64; }), "block_behind_producer");
+
+    CHECK(produced == 64);
+    CHECK(ordered);
+
+    vector<stage_stats> stats = pipeline.getStatistics();
+    CHECK(stats[0].dropped == 0 && stats[1].dropped == 0);
+}
+
+/* BLOCK source stage while the only pool thread is busy: the pushing thread runs the stage */
+static void block_on_busy_pool() {
+
+    ThreadPool pool(1);
+    atomic<bool> release(false);
+
+    {
+        Pipeline pipeline(pool);
+        atomic<unsigned int> consumed(0);
+
+        pipeline.addStage("consumer", [&](const FramePtr &) {
+            consumed++;
+            return FramePtr();
+        }, PIPELINE_SOURCE, BLOCK, 2);
+
+        block_pool(pool, release);
+
+        for (unsigned int i = 0; i < 32; ++i) pipeline.push(make_frame(i));
+
+        CHECK(consumed >= 30); // at most the capacity is left to the pool
+        CHECK(pipeline.getStatistics()[0].dropped == 0);
+
+        release = true;
+
+        check_progress(wait_for([&]() { return consumed == 32; }), "block_on_busy_pool");
+    }
+}
+
+/* DROP_OLDEST keeps the newest frames, DROP_NEWEST the oldest ones */
+static void drop_policies() {
+
+    ThreadPool pool(1);
+    atomic<bool> release(false);
+
+    {
+        Pipeline pipeline(pool);
+        vector<unsigned int> oldest_kept, newest_kept;
+        atomic<unsigned int> consumed(0);
+
+        pipeline.addStage("drop oldest", [&](const FramePtr &frame) {
+            newest_kept.push_back(frame->sequence);
+            consumed++;
+            return FramePtr();
+        }, PIPELINE_SOURCE, DROP_OLDEST, 4);
+
+        pipeline.addStage("drop newest", [&](const FramePtr &frame) {
+            oldest_kept.push_back(frame->sequence);
+            consumed++;
+            return FramePtr();
+        }, PIPELINE_SOURCE, DROP_NEWEST, 4);
+
+        block_pool(pool, release);
+
+        for (unsigned int i = 0; i < 10; ++i) pipeline.push(make_frame(i));
+
+        release = true;
+
+        check_progress(wait_for([&]() { return consumed == 8; }), "drop_policies");
+
+        CHECK(newest_kept == vector<unsigned int>({6, 7, 8, 9}));
+        CHECK(oldest_kept == vector<unsigned int>({0, 1, 2, 3}));
+
+        vector<stage_stats> stats = pipeline.getStatistics();
+        CHECK(stats[0].dropped == 6 && stats[1].dropped == 6);
+    }
+}
+
+/*
+ * Each frame is pushed while the stage is finishing the previous one: the runner going idle
+ * and the producer scheduling must not both miss the frame (it would wait for the next push)
+ */
+static void no_lost_wakeup() {
+
+    ThreadPool pool(2);
+    Pipeline pipeline(pool);
+
+    atomic<unsigned int> consumed(0);
+
+    pipeline.addStage("consumer", [&](const FramePtr &) {
+        consumed++;
+        return FramePtr();
+    }, PIPELINE_SOURCE, DROP_NEWEST, 2);
+
+    for (unsigned int i = 0; i < 20000; ++i) {
+
+        pipeline.push(make_frame(i));
+
+        auto deadline = chrono::steady_clock::now() + chrono::milliseconds(TIMEOUT_MS);
+
+        while (consumed != i + 1) {
+            if (chrono::steady_clock::now() > deadline) check_progress(false, "no_lost_wakeup");
+            this_thread::yield();
+        }
+    }
+
+    CHECK(consumed == 20000);
+}
+
+void pipeline_tests() {
+
+    no_lost_wakeup();
+    block_behind_producer();
+    block_on_busy_pool();
+    drop_policies();
+}
@@ -0,0 +1,87 @@
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+#include "tests.h"
+#include "framerecorder.h"
+#include "threadpool.h"
+
+static bool rejected_codec(const string &file_name, unsigned int codec) {
+
+    try {
+        FrameRecorder recorder(file_name, codec);
+    } catch (const runtime_error&) {
+        return true;
+    }
+
+    return false;
+}
+
+void recorder_tests() {
+
+    string file_name = "/tmp/v4l2tests-" + to_string(getpid()) + ".rec";
+
+    ThreadPool pool(2);
+
+    unsigned int line_bytes = 96, height = 10, stride = 100;
+    vector<unsigned char> image((size_t) stride * height);
+
+    for (size_t i = 0; i < image.size(); ++i) image[i] = (unsigned char) (i * 7 + i / stride);
+
+    struct timeval timestamp = {12, 345678};
+
+    /* codecs alternate per frame, padding is dropped */
+    {
+        FrameRecorder recorder(file_name, CODEC_RAW, &pool);
+
+        recorder.write(image.data(), line_bytes, height, stride, V4L2_PIX_FMT_GREY, 1, timestamp);
+        recorder.setCodec(CODEC_LOSSLESS);
+        recorder.write(image.data(), line_bytes, height, stride, V4L2_PIX_FMT_GREY, 2, timestamp);
+
+        CHECK(recorder.getRawBytes() == 2ULL * line_bytes * height);
+    }
+
+    {
+        FramePlayer player(file_name, &pool);
+        RecordedFrame frame;
+
+        for (unsigned int codec : {CODEC_RAW, CODEC_LOSSLESS}) {
+
+            CHECK(player.read(frame));
+            CHECK(frame.codec == codec);
+            CHECK(frame.line_bytes == line_bytes && frame.height == height);
+            CHECK(frame.timestamp == 12345678ULL);
+
+            bool same = frame.data.size() == (size_t) line_bytes * height;
+            for (unsigned int y = 0; same && y < height; ++y) {
+                same = equal(frame.data.begin() + (size_t) y * line_bytes, frame.data.begin() + (size_t) (y + 1) * line_bytes,
+                             image.begin() + (size_t) y * stride);
+            }
+            CHECK(same);
+        }
+
+        CHECK(!player.read(frame));
+    }
+
+    /* an unknown codec is rejected before the file is created */
+    remove(file_name.c_str());
+
+    CHECK(rejected_codec(file_name, 7));
+    CHECK(access(file_name.c_str(), F_OK) != 0);
+
+    {
+        FrameRecorder recorder(file_name);
+        bool rejected = false;
+        try {
+            recorder.setCodec(7);
+        } catch (const runtime_error&) {
+            rejected = true;
+        }
+        CHECK(rejected && recorder.getCodec() == CODEC_LOSSLESS);
+    }
+
+    remove(file_name.c_str());
+}
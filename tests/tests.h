@@ -0,0 +1,22 @@
+#ifndef TESTS_H
+#define TESTS_H
+
+#include <string>
+
+using namespace std;
+
+/*
+ * Minimal test harness: CHECK reports the failed condition and the run continues,
+ * the test program fails if any check failed.
+ */
+
+#define CHECK(condition) check_condition((condition), #condition, __FILE__, __LINE__)
+
+bool check_condition(bool passed, const char *condition, const char *file, int line);
+
+/* test suites, see tests/main.cpp */
+void codec_tests();
+void pipeline_tests();
+void recorder_tests();
+
+#endif // TESTS_H
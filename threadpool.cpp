@@ -0,0 +1,136 @@
+#include "threadpool.h"
+
+/* shared by the caller and the helper tasks of ThreadPool::parallel, helpers may start after it returns */
+struct ParallelJobs {
+
+    ParallelJobs(unsigned int count, const function<void(unsigned int)> &job) :
+        job(job), count(count), next(0), done(0)
+    {
+    }
+
+    function<void(unsigned int)> job;
+    unsigned int count;
+
+    atomic<unsigned int> next;
+
+    mutex done_mutex;
+    condition_variable done_condition;
+    unsigned int done;
+    exception_ptr error;
+
+    void run() {
+
+        unsigned int index;
+
+        while ((index = next++) < count) {
+
+            exception_ptr failure;
+
+            try {
+                job(index);
+            } catch (...) {
+                failure = current_exception();
+            }
+
+            lock_guard<mutex> lock(done_mutex);
+
+            if (failure && !error) error = failure;
+
+            if (++done == count) done_condition.notify_all();
+        }
+    }
+};
+
+// ========= ThreadPool class ========== //
+
+ThreadPool::ThreadPool(unsigned int threads) :
+    _stopping(false)
+{
+    if (threads == 0) {
+        threads = thread::hardware_concurrency();
+    }
+
+    if (threads == 0) threads = 1; // not computable
+
+    for (unsigned int i = 0; i < threads; ++i) {
+        _workers.push_back(thread([this]() {
+            work();
+        }));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+
+    {
+        lock_guard<mutex> lock(_mutex);
+        _stopping = true;
+    }
+
+    _condition.notify_all();
+
+    for (auto &worker : _workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(const function<void()> &task) {
+
+    {
+        lock_guard<mutex> lock(_mutex);
+        _tasks.push_back(task);
+    }
+
+    _condition.notify_one();
+}
+
+void ThreadPool::parallel(unsigned int count, const function<void(unsigned int)> &job) {
+
+    if (count == 0) return;
+
+    shared_ptr<ParallelJobs> jobs = make_shared<ParallelJobs>(count, job);
+
+    unsigned int helpers = (count - 1 < size()) ? count - 1 : size();
+
+    for (unsigned int i = 0; i < helpers; ++i) {
+        submit([jobs]() {
+            jobs->run();
+        });
+    }
+
+    jobs->run();
+
+    unique_lock<mutex> lock(jobs->done_mutex);
+
+    jobs->done_condition.wait(lock, [&jobs]() {
+        return jobs->done == jobs->count;
+    });
+
+    if (jobs->error) rethrow_exception(jobs->error);
+}
+
+unsigned int ThreadPool::size() const {
+    return (unsigned int) _workers.size();
+}
+
+void ThreadPool::work() {
+
+    while (true) {
+
+        function<void()> task;
+
+        {
+            unique_lock<mutex> lock(_mutex);
+
+            _condition.wait(lock, [this]() {
+                return _stopping || !_tasks.empty();
+            });
+
+            if (_tasks.empty()) return; // stopping and nothing left
+
+            task = move(_tasks.front());
+            _tasks.pop_front();
+        }
+
+        task();
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <exception>
+
+using namespace std;
+
+/**
+ * Fixed size thread pool, shared by the pipelines
+ */
+class ThreadPool {
+
+public:
+
+    /* 0 - one thread per hardware thread */
+    ThreadPool(unsigned int threads = 0);
+
+    /* pending tasks are completed before the workers exit */
+    ~ThreadPool();
+
+    /* Prohibit copy constructor and assignment operator */
+    ThreadPool(const ThreadPool&)            = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(const function<void()> &);
+
+    /*
+     * runs job(0) ... job(count - 1) on the pool and waits for them. The caller runs the jobs too,
+     * so it may be a worker of this pool. The first exception of the jobs is rethrown.
+     */
+    void parallel(unsigned int count, const function<void(unsigned int)> &job);
+
+    unsigned int size() const;
+
+private:
+
+    vector<thread> _workers;
+
+    deque<function<void()>> _tasks;
+
+    mutex _mutex;
+    condition_variable _condition;
+
+    bool _stopping;
+
+    void work();
+};
+
+#endif // THREADPOOL_H
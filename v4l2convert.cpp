@@ -0,0 +1,129 @@
+#include <cstdint>
+#include <linux/videodev2.h>
+
+#include "v4l2convert.h"
+
+/*
+ * Taken from libv4l2
+ */
+
+#define CLIP(color) (unsigned char)(((color) > 0xFF) ? 0xFF : (((color) < 0) ? 0 : (color)))
+
+unsigned int v4lconvert_pixel_bytes(unsigned int pixel_format)
+{
+    switch (pixel_format) {
+        case V4L2_PIX_FMT_YUYV:
+        case V4L2_PIX_FMT_YVYU:
+        case V4L2_PIX_FMT_UYVY:
+        case V4L2_PIX_FMT_VYUY:  return 2;
+        case V4L2_PIX_FMT_RGB24:
+        case V4L2_PIX_FMT_BGR24: return 3;
+        default:                 return 1;
+    }
+}
+
+void v4lconvert_yuyv_to_rgb24(
+        const unsigned char* source,
+        unsigned char *dest,
+        int width, int height, int stride)
+{
+    int j;
+
+    while (--height >= 0) {
+        for (j = 0; j + 1 < width; j += 2) {
+            int u = source[1];
+            int v = source[3];
+            int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
+            int rg = (((u - 128) << 1) +  (u - 128) +
+                      ((v - 128) << 2) + ((v - 128) << 1)) >> 3;
+            int v1 = (((v - 128) << 1) +  (v - 128)) >> 1;
+
+            *dest++ = CLIP(source[0] + v1);
+            *dest++ = CLIP(source[0] - rg);
+            *dest++ = CLIP(source[0] + u1);
+
+            *dest++ = CLIP(source[2] + v1);
+            *dest++ = CLIP(source[2] - rg);
+            *dest++ = CLIP(source[2] + u1);
+            source += 4;
+        }
+        source += stride - (width * 2);
+    }
+}
+
+#define RGB32(r, g, b) (0xFF000000u | ((uint32_t) (r) << 16) | ((uint32_t) (g) << 8) | (uint32_t) (b))
+
+void v4lconvert_yuyv_to_rgb32(
+        const unsigned char* source,
+        unsigned char *dest,
+        int width, int height, int stride, int dest_stride)
+{
+    int j;
+
+    while (--height >= 0) {
+
+        uint32_t *pixel = (uint32_t*) dest;
+
+        for (j = 0; j + 1 < width; j += 2) {
+            int u = source[1];
+            int v = source[3];
+            int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
+            int rg = (((u - 128) << 1) +  (u - 128) +
+                      ((v - 128) << 2) + ((v - 128) << 1)) >> 3;
+            int v1 = (((v - 128) << 1) +  (v - 128)) >> 1;
+
+            *pixel++ = RGB32(CLIP(source[0] + v1), CLIP(source[0] - rg), CLIP(source[0] + u1));
+            *pixel++ = RGB32(CLIP(source[2] + v1), CLIP(source[2] - rg), CLIP(source[2] + u1));
+            source += 4;
+        }
+        source += stride - (width * 2);
+        dest   += dest_stride;
+    }
+}
+
+void v4lconvert_bayer_to_rgb24(
+        const unsigned char *source,
+        unsigned char *dest,
+        int width, int height, int stride, unsigned int pixel_format)
+{
+    /* red and blue positions within the quad (row-major), greens are the others */
+    int r, b;
+
+    switch (pixel_format) {
+        case V4L2_PIX_FMT_SBGGR8: b = 0; r = 3; break;
+        case V4L2_PIX_FMT_SGBRG8: b = 1; r = 2; break;
+        case V4L2_PIX_FMT_SRGGB8: r = 0; b = 3; break;
+        case V4L2_PIX_FMT_SGRBG8:
+        default:                  r = 1; b = 2; break;
+    }
+
+    int g0 = (r == 0 || r == 3) ? 1 : 0;
+    int g1 = (r == 0 || r == 3) ? 2 : 3;
+
+    for (int y = 0; y + 1 < height; y += 2) {
+
+        const unsigned char *top    = source + y * stride;
+        const unsigned char *bottom = top + stride;
+
+        unsigned char *out_top    = dest + y * width * 3;
+        unsigned char *out_bottom = out_top + width * 3;
+
+        for (int x = 0; x + 1 < width; x += 2) {
+
+            unsigned char quad[4] = { top[x], top[x + 1], bottom[x], bottom[x + 1] };
+
+            unsigned char red   = quad[r];
+            unsigned char green = (unsigned char) ((quad[g0] + quad[g1] + 1) >> 1);
+            unsigned char blue  = quad[b];
+
+            for (int i = 0; i < 2; ++i) {
+                *out_top++    = red;
+                *out_top++    = green;
+                *out_top++    = blue;
+                *out_bottom++ = red;
+                *out_bottom++ = green;
+                *out_bottom++ = blue;
+            }
+        }
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef V4L2CONVERT_H
+#define V4L2CONVERT_H
+
+/*
+ * Raw frame converters, see libv4lconvert
+ */
+
+/* bytes per pixel of the packed formats (1 for Bayer and GREY), planar and compressed ones are not supported */
+unsigned int v4lconvert_pixel_bytes(unsigned int pixel_format);
+
+/* YUYV (4:2:2) to packed RGB24, width must be even */
+void v4lconvert_yuyv_to_rgb24(const unsigned char *source, unsigned char *dest,
+                              int width, int height, int stride);
+
+/* YUYV (4:2:2) to 32-bit 0xffRRGGBB pixels (QImage::Format_RGB32), dest_stride in bytes */
+void v4lconvert_yuyv_to_rgb32(const unsigned char *source, unsigned char *dest,
+                              int width, int height, int stride, int dest_stride);
+
+/*
+ * 8-bit Bayer to packed RGB24, each 2x2 quad gives one color (fast, half resolution chroma).
+ * pixel_format is one of V4L2_PIX_FMT_S{BGGR,GBRG,GRBG,RGGB}8, width and height must be even
+ */
+void v4lconvert_bayer_to_rgb24(const unsigned char *source, unsigned char *dest,
+                               int width, int height, int stride, unsigned int pixel_format);
+
+#endif // V4L2CONVERT_H
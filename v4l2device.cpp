@@ -3,13 +3,16 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/mman.h>
 #include <linux/videodev2.h>
 #include <cstring>
 #include <iostream>
 #include <functional>
+#include <algorithm>
 
 #include "v4l2device.h"
+#include "v4l2convert.h"
 
 /* ioctl fucntion */
 static int v4l2_ioctl(int fd, unsigned long int request, void *arg) {
@@ -24,24 +27,55 @@ static int v4l2_ioctl(int fd, unsigned long int request, void *arg) {
     return status_code;
 }
 
+/* no buffer is being delivered */
+#define NO_BUFFER ((unsigned int) -1)
+
+unsigned long long timestamp_latency(const struct timeval &timestamp) {
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    long long latency = (now.tv_sec - timestamp.tv_sec) * 1000000LL +
+                        now.tv_nsec / 1000 - timestamp.tv_usec;
+
+    return latency > 0 ? (unsigned long long) latency : 0;
+}
+
+unsigned long long buffer_latency(const struct v4l2_buffer &buffer_info) {
+
+    if ((buffer_info.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) != V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+        return 0;
+    }
+
+    return timestamp_latency(buffer_info.timestamp);
+}
+
 // ========= V4L2Device class ========== //
 
 V4L2Device::V4L2Device(const v4l2_device_param &parameters) :
-    _is_capturing(false), _parameters(parameters)
+    _is_capturing(false), _is_running(true), _parameters(parameters), _memory(V4L2_MEMORY_MMAP), _swap_buffer(-1), _delivered_buffer(NO_BUFFER),
+    _hardware_crop(false), _crop({0, 0, 0, 0}), _roi({0, 0, 0, 0}), _default_crop({0, 0, 0, 0}), _frames_since_delivery(0),
+    _frames_captured(0), _frames_delivered(0), _frames_skipped(0), _frames_dropped(0),
+    _latency_last(0), _latency_sum(0), _latency_count(0), _latency_max(0)
 {
     open_device();
     init_device();
 
     // start streaming in a new thread
-    thread([&](){
+    _stream_thread = thread([&](){
         stream();
-    }).detach();
+    });
 
     printInfo();
 }
 
 V4L2Device::~V4L2Device() {
     stopCapturing();
+
+    // the streaming thread must not outlive the buffers
+    _is_running = false;
+    _stream_thread.join();
+
     uninit_device();
     close_device();
 }
@@ -89,14 +123,44 @@ void V4L2Device::close_device() {
 void V4L2Device::init_device() {
     query_capability();
     query_format();
+    init_roi();
     init_fps();
     init_buffers();
+
+    if (_parameters.memory == V4L2_MEMORY_USERPTR) {
+
+        if (init_userptr()) {
+            if (_parameters.export_dmabuf) {
+                cerr << "VIDIOC_EXPBUF is available for MMAP buffers only" << endl;
+            }
+            return;
+        }
+
+        cerr << _parameters.dev_name << " doesn't support user pointers, falling back to MMAP" << endl;
+    }
+
     init_mmap();
+
+    if (_parameters.export_dmabuf) {
+        export_buffers();
+    }
 }
 
 void V4L2Device::uninit_device() {
-    // unmap buffers
+
+    if (_free_buffers.size() < _parameters.spare_buffers) {
+        cerr << _parameters.dev_name << ": " << _parameters.spare_buffers - _free_buffers.size()
+             << " buffers are still held" << endl;
+    }
+
+    // unmap buffers, both MMAP and USERPTR buffers are memory mappings
     for (auto &buf : _buffers) {
+
+        if (buf.dmabuf_fd != -1) {
+            close(buf.dmabuf_fd);
+            buf.dmabuf_fd = -1;
+        }
+
         if (munmap(buf.data, buf.size) == -1) {
             throw runtime_error(string(strerror(errno)) + ". MUNMAP");
         }
@@ -160,6 +224,232 @@ void V4L2Device::query_format() {
     cout << "bytes per line: " << _format.fmt.pix.bytesperline << endl;
 }
 
+void V4L2Device::refresh_format() {
+
+    struct v4l2_format format = {0};
+
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+    if (v4l2_ioctl(_fd, VIDIOC_G_FMT, &format) == -1) {
+        throw runtime_error("VIDIOC_G_FMT");
+    }
+
+    _format = format;
+}
+
+/*
+ * Region with even origin and size (keeps the Bayer phase and whole YUYV macropixels)
+ * clipped to width x height, false if nothing is left
+ */
+static bool even_region(long long left, long long top, long long right, long long bottom,
+                        unsigned int width, unsigned int height, struct v4l2_rect &region) {
+
+    if (left < 0) left = 0;
+    if (top  < 0) top  = 0;
+    if (right  > (long long) width)  right  = width;
+    if (bottom > (long long) height) bottom = height;
+
+    left   &= ~1LL;
+    top    &= ~1LL;
+    right  &= ~1LL;
+    bottom &= ~1LL;
+
+    if (right <= left || bottom <= top) return false;
+
+    region = {(int) left, (int) top, (unsigned int) (right - left), (unsigned int) (bottom - top)};
+
+    return true;
+}
+
+void V4L2Device::init_roi() {
+
+    _hardware_crop = false;
+    _crop = {0, 0, getWidth(), getHeight()};
+    _roi  = _crop;
+
+    /*
+     * the full frame is the sensor's default crop, frame coordinates are translated by its origin;
+     * a driver which scales the default crop to the format has no such mapping (software ROI only)
+     */
+    if (!get_default_crop(_default_crop) || _default_crop.width != getWidth() || _default_crop.height != getHeight()) {
+        _default_crop = {0, 0, 0, 0};
+    }
+
+    if (_parameters.roi.width == 0 || _parameters.roi.height == 0) return; // full frame
+
+    if (apply_hardware_crop(_parameters.roi)) return;
+
+    cerr << _parameters.dev_name << " can't crop the frame, falling back to software ROI" << endl;
+
+    apply_software_roi(_parameters.roi);
+}
+
+bool V4L2Device::get_default_crop(struct v4l2_rect &rect) {
+
+    struct v4l2_selection selection = {0};
+
+    selection.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    selection.target = V4L2_SEL_TGT_CROP_DEFAULT;
+
+    if (v4l2_ioctl(_fd, VIDIOC_G_SELECTION, &selection) == 0) {
+        rect = selection.r;
+        return true;
+    }
+
+    /* older drivers implement the crop API only */
+    struct v4l2_cropcap cropcap = {0};
+
+    cropcap.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+    if (v4l2_ioctl(_fd, VIDIOC_CROPCAP, &cropcap) == 0) {
+        rect = cropcap.defrect;
+        return true;
+    }
+
+    return false; // the driver doesn't crop at all
+}
+
+struct v4l2_rect V4L2Device::to_sensor(const struct v4l2_rect &rect) const {
+    return {rect.left + _default_crop.left, rect.top + _default_crop.top, rect.width, rect.height};
+}
+
+struct v4l2_rect V4L2Device::to_frame(const struct v4l2_rect &rect) const {
+    return {rect.left - _default_crop.left, rect.top - _default_crop.top, rect.width, rect.height};
+}
+
+bool V4L2Device::set_crop(struct v4l2_rect &rect) {
+
+    struct v4l2_selection selection = {0};
+
+    selection.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    selection.target = V4L2_SEL_TGT_CROP;
+    selection.r      = rect;
+
+    // the driver adjusts the rectangle to its constraints
+    if (v4l2_ioctl(_fd, VIDIOC_S_SELECTION, &selection) == 0) {
+        rect = selection.r;
+        return true;
+    }
+
+    /* older drivers implement the crop API only */
+    struct v4l2_crop crop = {0};
+
+    crop.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    crop.c    = rect;
+
+    if (v4l2_ioctl(_fd, VIDIOC_S_CROP, &crop) == -1) return false; // not supported or busy
+
+    if (v4l2_ioctl(_fd, VIDIOC_G_CROP, &crop) == 0) {
+        rect = crop.c;
+    }
+
+    return true;
+}
+
+bool V4L2Device::fits_buffers() const {
+
+    /* the buffers may be allocated already, the frame must fit them */
+    for (const auto &buf : _buffers) {
+        if (buf.data && buf.size < getImageSize()) return false;
+    }
+
+    return true;
+}
+
+bool V4L2Device::apply_hardware_crop(const struct v4l2_rect &rect) {
+
+    if (_default_crop.width == 0) return false; // no mapping to the sensor's coordinates
+
+    struct v4l2_rect region;
+
+    if (!even_region(rect.left, rect.top, (long long) rect.left + rect.width, (long long) rect.top + rect.height,
+                     _default_crop.width, _default_crop.height, region)) {
+        return false;
+    }
+
+    struct v4l2_rect crop = to_sensor(region);
+
+    if (!set_crop(crop)) return false;
+
+    refresh_format();
+
+    crop = to_frame(crop); // as adjusted by the driver
+
+    /*
+     * NOTE: a driver which scales the crop back to the format's size
+     * doesn't save the bandwidth, the region is cut out in software then;
+     * an odd origin would flip the Bayer phase
+     */
+    if (fits_buffers() && getWidth() == crop.width && getHeight() == crop.height &&
+            (crop.left & 1) == 0 && (crop.top & 1) == 0) {
+        _hardware_crop = true;
+        _crop = crop;
+        _roi  = {0, 0, getWidth(), getHeight()};
+        return true;
+    }
+
+    // restore the previous crop
+    if (_hardware_crop) {
+
+        crop = to_sensor(_crop);
+
+        if (!set_crop(crop)) {
+            /* Never mind */
+            cerr << "VIDIOC_S_SELECTION" << endl;
+        }
+
+        refresh_format();
+
+    } else {
+        reset_hardware_crop();
+    }
+
+    return false;
+}
+
+void V4L2Device::reset_hardware_crop() {
+
+    struct v4l2_rect crop;
+
+    if (!get_default_crop(crop)) return;
+
+    struct v4l2_rect previous = to_sensor(_crop);
+
+    if (!set_crop(crop)) {
+        /* Never mind */
+        cerr << "VIDIOC_S_SELECTION" << endl;
+        return;
+    }
+
+    refresh_format();
+
+    // the full frame doesn't fit the buffers allocated for the crop
+    if (_hardware_crop && !fits_buffers()) {
+
+        if (!set_crop(previous)) {
+            throw runtime_error("VIDIOC_S_SELECTION");
+        }
+
+        refresh_format();
+        return;
+    }
+
+    _hardware_crop = false;
+    _crop = {0, 0, getWidth(), getHeight()};
+}
+
+void V4L2Device::apply_software_roi(const struct v4l2_rect &rect) {
+
+    /* captured frame's coordinates, _crop is in the frame's ones */
+    long long left = (long long) rect.left - _crop.left;
+    long long top  = (long long) rect.top  - _crop.top;
+
+    if (!even_region(left, top, left + rect.width, top + rect.height, _crop.width, _crop.height, _roi)) {
+        cerr << "ROI is outside of the captured frame, the full frame is used" << endl;
+        _roi = {0, 0, _crop.width, _crop.height};
+    }
+}
+
 void V4L2Device::init_fps() {
 
     struct v4l2_streamparm stream_param = {0};
@@ -185,7 +475,25 @@ void V4L2Device::init_buffers() {
     _buffers.reserve(_parameters.n_buffers);
 
     for (unsigned int i = 0; i < _parameters.n_buffers; ++i) {
-        _buffers.push_back(Buffer{0});
+        Buffer buffer = {0};
+        buffer.dmabuf_fd = -1;
+        buffer.index     = i;
+        _buffers.push_back(buffer);
+        _slots.push_back(i);
+    }
+}
+
+void V4L2Device::init_spare_buffers() {
+
+    // spare buffers replace the held ones in the driver's queue
+    for (unsigned int i = 0; i < _parameters.spare_buffers; ++i) {
+
+        Buffer buffer = {0};
+        buffer.dmabuf_fd = -1;
+        buffer.index     = (unsigned int) _buffers.size();
+
+        _free_buffers.push_back(buffer.index);
+        _buffers.push_back(buffer);
     }
 }
 
@@ -193,7 +501,8 @@ void V4L2Device::init_mmap() {
 
     struct v4l2_requestbuffers req_buffers = {0};
 
-    req_buffers.count  = _parameters.n_buffers;
+    /* only n_buffers are queued, the spare ones replace the held buffers */
+    req_buffers.count  = _parameters.n_buffers + _parameters.spare_buffers;
     req_buffers.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     req_buffers.memory = V4L2_MEMORY_MMAP;
 
@@ -207,11 +516,13 @@ void V4L2Device::init_mmap() {
     }
 
     /* driver might allocate less number of buffers */
-    if (req_buffers.count != _parameters.n_buffers) {
+    if (req_buffers.count != _parameters.n_buffers + _parameters.spare_buffers) {
         throw runtime_error("Invalid requested buffers number");
     }
 
-    /* put application buffers into driver's incoming queue in order to get raw data */
+    init_spare_buffers();
+
+    /* map all buffers, the queued ones are put into driver's incoming queue by startCapturing */
     for (unsigned int buffer_idx = 0; buffer_idx < req_buffers.count; ++buffer_idx) {
 
         struct v4l2_buffer buffer_info = {0};
@@ -235,6 +546,94 @@ void V4L2Device::init_mmap() {
             throw runtime_error("MMAP");
         }
     }
+
+    _memory = V4L2_MEMORY_MMAP;
+}
+
+bool V4L2Device::init_userptr() {
+
+    struct v4l2_requestbuffers req_buffers = {0};
+
+    req_buffers.count  = _parameters.n_buffers;
+    req_buffers.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req_buffers.memory = V4L2_MEMORY_USERPTR;
+
+    /* switch the driver into user pointer mode, no buffers are allocated by the driver */
+    if (v4l2_ioctl(_fd, VIDIOC_REQBUFS, &req_buffers) == -1) {
+        if (errno == EINVAL) {
+            return false;
+        } else {
+            throw runtime_error("VIDIOC_REQBUFS");
+        }
+    }
+
+    /* driver might allow less number of buffers */
+    if (req_buffers.count != _parameters.n_buffers) {
+        throw runtime_error("Invalid requested buffers number");
+    }
+
+    init_spare_buffers();
+
+    for (auto &buf : _buffers) {
+        buf.size = getImageSize();
+        buf.data = allocate_user_buffer(buf.size);
+    }
+
+    _memory = V4L2_MEMORY_USERPTR;
+
+    return true;
+}
+
+void *V4L2Device::allocate_user_buffer(size_t &size) {
+
+    /* anonymous mappings are page aligned, as required by most drivers */
+    size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+
+    if (_parameters.huge_pages) {
+
+        size_t huge_size = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+        void *data = mmap(nullptr, huge_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if (data != MAP_FAILED) {
+            size = huge_size;
+            return data;
+        }
+
+        /* Never mind, no huge pages reserved */
+        cerr << "MAP_HUGETLB: " << strerror(errno) << endl;
+    }
+
+    size = (size + page_size - 1) / page_size * page_size;
+
+    void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (data == MAP_FAILED) {
+        throw runtime_error("MMAP");
+    }
+
+    return data;
+}
+
+void V4L2Device::export_buffers() {
+
+    for (unsigned int buffer_idx = 0; buffer_idx < _buffers.size(); ++buffer_idx) {
+
+        struct v4l2_exportbuffer export_info = {0};
+
+        export_info.type  = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        export_info.index = buffer_idx;
+        export_info.flags = O_RDONLY | O_CLOEXEC;
+
+        if (v4l2_ioctl(_fd, VIDIOC_EXPBUF, &export_info) == -1) {
+            /* Never mind, buffers are still available via mmap */
+            cerr << _parameters.dev_name << " VIDIOC_EXPBUF: " << strerror(errno) << endl;
+            return;
+        }
+
+        _buffers[buffer_idx].dmabuf_fd = export_info.fd;
+    }
 }
 
 // =============================================== //
@@ -248,7 +647,7 @@ void V4L2Device::startCapturing() {
         struct v4l2_buffer buffer_info = {0};
 
         buffer_info.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buffer_info.memory = V4L2_MEMORY_MMAP;
+        buffer_info.memory = _memory;
 
         /*
          * NOTE: some devices will refuse to get into streaming mode
@@ -256,7 +655,13 @@ void V4L2Device::startCapturing() {
          */
         for (unsigned int i = 0; i < _parameters.n_buffers; ++i) {
 
-            buffer_info.index  = i;
+            if (_memory == V4L2_MEMORY_USERPTR) {
+                buffer_info.index     = i;
+                buffer_info.m.userptr = (unsigned long) _buffers[_slots[i]].data;
+                buffer_info.length    = _buffers[_slots[i]].size;
+            } else {
+                buffer_info.index     = _slots[i]; // neither spare nor held
+            }
 
             if (v4l2_ioctl(_fd, VIDIOC_QBUF, &buffer_info) == -1) {
                 throw runtime_error("VIDIOC_QBUF");
@@ -330,9 +735,90 @@ bool V4L2Device::read_frame() {
     struct v4l2_buffer buffer_info = {0};
 
     buffer_info.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    buffer_info.memory = V4L2_MEMORY_MMAP;
+    buffer_info.memory = _memory;
 
     // get frame from driver's outgoing queue
+    if (!dequeue_buffer(buffer_info)) return false;
+
+    _frames_captured++;
+
+    /* keep only the newest frame, the stale ones go back to the driver at once */
+    while (_parameters.drain_to_newest) {
+
+        struct v4l2_buffer newer_info = {0};
+
+        newer_info.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        newer_info.memory = _memory;
+
+        if (!dequeue_buffer(newer_info)) break;
+
+        _frames_captured++;
+        _frames_dropped++;
+
+        if (v4l2_ioctl(_fd, VIDIOC_QBUF, &buffer_info) == -1) {
+            throw runtime_error("VIDIOC_QBUF");
+        }
+
+        buffer_info = newer_info;
+    }
+
+    Buffer &buffer = (_memory == V4L2_MEMORY_USERPTR) ? _buffers[_slots[buffer_info.index]] : _buffers[buffer_info.index];
+
+    /* the region of interest is a view into the captured buffer */
+    buffer.image  = (unsigned char*) buffer.data + (size_t) _roi.top * getStride() +
+                    (size_t) _roi.left * v4lconvert_pixel_bytes(_format.fmt.pix.pixelformat);
+    buffer.width  = _roi.width;
+    buffer.height = _roi.height;
+    buffer.stride = getStride();
+
+    if (pass_change_gate(buffer)) {
+
+        _frames_delivered++;
+
+        if (_parameters.stats_step) { // statistics are computed on the raw region
+            compute_image_statistics((const unsigned char*) buffer.image, buffer.width, buffer.height, buffer.stride,
+                                     _format.fmt.pix.pixelformat, _parameters.stats_step, buffer.stats);
+        }
+
+        if (_callback) { // callback
+            _delivered_buffer = buffer.index;
+            _callback(buffer, buffer_info);
+            _delivered_buffer = NO_BUFFER; // holdBuffer is valid within the callback only
+        }
+
+        update_latency(buffer_info); // the consumer is done with the frame
+
+    } else {
+        _frames_skipped++;
+    }
+
+    /* the consumer keeps the buffer, a spare one is queued instead */
+    if (_swap_buffer != -1) {
+
+        unsigned int spare = (unsigned int) _swap_buffer;
+        _swap_buffer = -1;
+
+        if (_memory == V4L2_MEMORY_USERPTR) {
+            _slots[buffer_info.index] = spare;
+
+            buffer_info.m.userptr = (unsigned long) _buffers[spare].data;
+            buffer_info.length    = _buffers[spare].size;
+        } else {
+            replace(_slots.begin(), _slots.end(), buffer.index, spare);
+
+            buffer_info.index = spare; // MMAP buffers have their own indices
+        }
+    }
+
+    if (v4l2_ioctl(_fd, VIDIOC_QBUF, &buffer_info) == -1) {
+        throw runtime_error("VIDIOC_QBUF");
+    }
+
+    return true;
+}
+
+bool V4L2Device::dequeue_buffer(struct v4l2_buffer &buffer_info) {
+
     if (v4l2_ioctl(_fd, VIDIOC_DQBUF, &buffer_info) == -1) {
         switch (errno) {
             case EAGAIN:
@@ -346,21 +832,49 @@ bool V4L2Device::read_frame() {
         }
     }
 
-    if (_callback) { // callback
-        _callback(_buffers[buffer_info.index], buffer_info);
-    }
+    return true;
+}
 
+void V4L2Device::update_latency(const struct v4l2_buffer &buffer_info) {
 
-    if (v4l2_ioctl(_fd, VIDIOC_QBUF, &buffer_info) == -1) {
-        throw runtime_error("VIDIOC_QBUF");
+    unsigned long long latency = buffer_latency(buffer_info);
+
+    if (latency == 0) return;
+
+    _latency_last = latency;
+    _latency_sum += latency;
+    _latency_count++;
+
+    if (latency > _latency_max) _latency_max = latency;
+}
+
+bool V4L2Device::pass_change_gate(const Buffer& buffer) {
+
+    // gate is disabled
+    if (_parameters.change_threshold <= 0) return true;
+
+    const unsigned char *frame = (const unsigned char*) buffer.image;
+
+    unsigned int line_bytes = buffer.width * v4lconvert_pixel_bytes(_format.fmt.pix.pixelformat);
+
+    bool refresh = !_change_detector.hasReference() ||
+                   _frames_since_delivery + 1 >= _parameters.change_refresh;
+
+    if (!refresh && _change_detector.difference(frame, line_bytes, buffer.height, buffer.stride) < _parameters.change_threshold) {
+        _frames_since_delivery++;
+        return false;
     }
 
+    /* compare next frames against the delivered one, so slow drift is not lost */
+    _change_detector.setReference(frame, line_bytes, buffer.height, buffer.stride);
+    _frames_since_delivery = 0;
+
     return true;
 }
 
 void V4L2Device::stream() {
 
-    while (true) {
+    while (_is_running) {
 
         if (_is_capturing) {
 
@@ -384,9 +898,7 @@ void V4L2Device::stream() {
              */
             this_thread::sleep_for(chrono::milliseconds(10));
         }
-
     }
-
 }
 
 // ======================================= //
@@ -431,10 +943,122 @@ unsigned int V4L2Device::getPixelField() const {
     return _format.fmt.pix.field;
 }
 
+unsigned int V4L2Device::getMemory() const {
+    return _memory;
+}
+
 void V4L2Device::setCallback(const function<void (const Buffer&, const struct v4l2_buffer&)> &callback) {
     _callback = callback;
 }
 
+v4l2_stream_stats V4L2Device::getStreamStatistics() const {
+
+    v4l2_stream_stats stats = {};
+
+    stats.frames_captured  = _frames_captured;
+    stats.frames_delivered = _frames_delivered;
+    stats.frames_skipped   = _frames_skipped;
+    stats.frames_dropped   = _frames_dropped;
+    stats.skip_rate        = stats.frames_captured ?
+                (double) stats.frames_skipped / stats.frames_captured : 0.0;
+
+    unsigned long long count = _latency_count;
+
+    stats.latency_last = _latency_last / 1e3;
+    stats.latency_avg  = count ? _latency_sum / 1e3 / count : 0.0;
+    stats.latency_max  = _latency_max / 1e3;
+
+    return stats;
+}
+
+void V4L2Device::setRoi(const struct v4l2_rect &rect) {
+
+    lock_guard<mutex> lock(_stream_mutex);
+
+    _parameters.roi = rect;
+
+    // the region's geometry changes, the reference frame is stale
+    _change_detector.reset();
+    _frames_since_delivery = 0;
+
+    if (rect.width == 0 || rect.height == 0) { // full frame
+
+        if (_hardware_crop && !_is_capturing) {
+            reset_hardware_crop();
+        }
+
+        _roi = {0, 0, _crop.width, _crop.height};
+        return;
+    }
+
+    /* drivers which don't allow to crop while streaming return EBUSY */
+    if (apply_hardware_crop(rect)) return;
+
+    if (_hardware_crop && !_is_capturing) {
+        reset_hardware_crop();
+    }
+
+    // otherwise the region is cut out of the current sensor's crop
+    apply_software_roi(rect);
+}
+
+struct v4l2_rect V4L2Device::getRoi() const {
+    return _roi;
+}
+
+bool V4L2Device::isHardwareCrop() const {
+    return _hardware_crop;
+}
+
+bool V4L2Device::holdBuffer(const Buffer &buffer) {
+
+    // only the buffer being delivered can be held, once
+    if (_swap_buffer != -1 || buffer.index != _delivered_buffer) {
+        return false;
+    }
+
+    lock_guard<mutex> lock(_pool_mutex);
+
+    if (_free_buffers.empty()) return false;
+
+    _swap_buffer = (int) _free_buffers.back();
+    _free_buffers.pop_back();
+
+    return true;
+}
+
+void V4L2Device::releaseBuffer(unsigned int index) {
+
+    lock_guard<mutex> lock(_pool_mutex);
+
+    _free_buffers.push_back(index);
+}
+
+int V4L2Device::getControl(unsigned int id) {
+
+    struct v4l2_control control = {0};
+
+    control.id = id;
+
+    if (v4l2_ioctl(_fd, VIDIOC_G_CTRL, &control) == -1) {
+        throw runtime_error("VIDIOC_G_CTRL " + to_string(id) + ": " + strerror(errno));
+    }
+
+    return control.value;
+}
+
+void V4L2Device::setControl(unsigned int id, int value) {
+
+    struct v4l2_control control = {0};
+
+    control.id    = id;
+    control.value = value;
+
+    if (v4l2_ioctl(_fd, VIDIOC_S_CTRL, &control) == -1) {
+        throw runtime_error("VIDIOC_S_CTRL " + to_string(id) + ": " + strerror(errno));
+    }
+}
+
 void V4L2Device::printInfo() {
 
     cout << "===============" << _parameters.dev_name << "==================" << endl;
@@ -492,5 +1116,24 @@ void V4L2Device::printInfo() {
 
     cout << "=================================" << endl;
 
-    printf("Buffers number: %d\n", _parameters.n_buffers);
+    printf("ROI: %dx%d+%d+%d (%s)\n", _roi.width, _roi.height, _crop.left + _roi.left, _crop.top + _roi.top,
+           _hardware_crop ? "sensor crop" : (_roi.width == getWidth() && _roi.height == getHeight() ? "full frame" : "software"));
+
+    cout << "=================================" << endl;
+
+    printf("Buffers number: %d%s\n", _parameters.n_buffers,
+           _parameters.drain_to_newest ? " (drain to newest)" : "");
+
+    printf("Spare buffers: %d\n", _parameters.spare_buffers);
+
+    printf("Memory: %s%s\n", _memory == V4L2_MEMORY_USERPTR ? "USERPTR" : "MMAP",
+           !_buffers.empty() && _buffers[0].dmabuf_fd != -1 ? " (DMABUF exported)" : "");
+
+    if (_parameters.change_threshold > 0) {
+
+        cout << "=================================" << endl;
+
+        printf("Change gate: threshold %.2f, refresh every %d frames\n",
+               _parameters.change_threshold, _parameters.change_refresh);
+    }
 }
@@ -10,23 +10,50 @@
 #include <functional>
 #include <linux/videodev2.h>
 
+#include "framediff.h"
+#include "imagestats.h"
+
 #define DEV_NAME "/dev/video0"
 
 #define BUFFER_SIZE 10
 
+/* suggested buffers number for the drain to newest mode */
+#define LOW_LATENCY_BUFFER_SIZE 3
+
 #define WIDTH  1280
 #define HEIGHT 720
 
+#define CHANGE_REFRESH 30
+
+/* buffers in the pool besides the driver's queue */
+#define SPARE_BUFFERS 4
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
 using namespace std;
 
 /**
  * Frames buffer structure
- * @param data  - pointer to the raw frame data
- * @param size  - data size (in bytes)
+ * @param data      - pointer to the raw frame data
+ * @param size      - data size (in bytes)
+ * @param dmabuf_fd - exported DMABUF file descriptor (-1 if not exported)
+ * @param stats     - statistics of the delivered frame (stats.samples is 0 if disabled)
+ * @param image     - first pixel of the delivered region of interest inside data
+ * @param width     - width of the delivered region (pixels)
+ * @param height    - height of the delivered region (rows)
+ * @param stride    - distance between the region's rows (bytes)
+ * @param index     - position in the device's buffer pool
  */
 typedef struct {
     void *data;
     size_t size;
+    int dmabuf_fd;
+    ImageStatistics stats;
+    void *image;
+    unsigned int width;
+    unsigned int height;
+    unsigned int stride;
+    unsigned int index;
 } Buffer;
 
 
@@ -48,13 +75,91 @@ typedef struct {
     /* buffer */
     unsigned int n_buffers = BUFFER_SIZE;
 
+    /*
+     * low latency mode: all ready buffers are dequeued on each wakeup,
+     * only the newest one is delivered, stale ones are requeued at once
+     * (use with LOW_LATENCY_BUFFER_SIZE buffers)
+     */
+    bool drain_to_newest = false;
+
+    /*
+     * V4L2_MEMORY_MMAP    - driver allocated buffers,
+     * V4L2_MEMORY_USERPTR - driver captures into the application's page aligned pool
+     * (falls back to V4L2_MEMORY_MMAP if not supported)
+     */
+    unsigned int memory = V4L2_MEMORY_MMAP;
+
+    /*
+     * the pool holds n_buffers + spare_buffers buffers (MMAP and USERPTR), only n_buffers are queued;
+     * a consumer may keep up to spare_buffers frames without copying (see V4L2Device::holdBuffer)
+     */
+    unsigned int spare_buffers = SPARE_BUFFERS;
+
+    /* allocate the USERPTR pool in huge pages (falls back to normal pages) */
+    bool huge_pages = false;
+
+    /*
+     * export MMAP buffers (spare ones included) as DMABUF file descriptors (VIDIOC_EXPBUF),
+     * a descriptor may be passed on beyond the callback while its buffer is held
+     */
+    bool export_dmabuf = false;
+
     /* format */
     unsigned int pixel_format = V4L2_PIX_FMT_YUYV;
     unsigned int pix_field    = V4L2_FIELD_INTERLACED;
 
+    /*
+     * region of interest in the frame's coordinates (width or height 0 - full frame):
+     * cropped by the sensor (VIDIOC_S_SELECTION, VIDIOC_S_CROP) if supported,
+     * otherwise only the region of the captured buffer is delivered (no copy)
+     */
+    struct v4l2_rect roi = {0, 0, 0, 0};
+
+    /*
+     * change detection gate: frames which differ from the last delivered one
+     * by less than change_threshold (mean absolute difference per byte, 0 - disabled)
+     * are not passed to the callback; a frame is forced every change_refresh frames
+     */
+    double       change_threshold = 0;
+    unsigned int change_refresh   = CHANGE_REFRESH;
+
+    /* image statistics sampling step (see imagestats.h), 0 - disabled */
+    unsigned int stats_step = 0;
+
 } v4l2_device_param;
 
 
+/**
+ * Stream statistics structure
+ * @param frames_captured  - frames dequeued from the driver
+ * @param frames_delivered - frames passed to the callback
+ * @param frames_skipped   - frames dropped by the change detection gate
+ * @param frames_dropped   - stale frames dropped in the drain to newest mode
+ * @param skip_rate        - frames_skipped / frames_captured
+ * @param latency_last     - glass-to-consumer latency of the last delivered frame (ms),
+ *                           from the capture timestamp until the callback returned
+ * @param latency_avg      - average glass-to-consumer latency (ms)
+ * @param latency_max      - maximal glass-to-consumer latency (ms)
+ */
+typedef struct {
+    unsigned long long frames_captured;
+    unsigned long long frames_delivered;
+    unsigned long long frames_skipped;
+    unsigned long long frames_dropped;
+    double skip_rate;
+    double latency_last;
+    double latency_avg;
+    double latency_max;
+} v4l2_stream_stats;
+
+
+/* time since capture of the buffer (in microseconds), 0 if driver's timestamps are not monotonic */
+unsigned long long buffer_latency(const struct v4l2_buffer&);
+
+/* time since the CLOCK_MONOTONIC timestamp (in microseconds) */
+unsigned long long timestamp_latency(const struct timeval&);
+
+
 /**
  * Represents v4l2 device, i.e. /dev/video0
  */
@@ -94,8 +199,42 @@ public:
 
     unsigned int getPixelField() const;
 
+    unsigned int getMemory() const;
+
     void setCallback(const function<void(const Buffer&, const struct v4l2_buffer&)> &);
 
+    v4l2_stream_stats getStreamStatistics() const;
+
+    // ============ Buffer pool =========== //
+
+    /*
+     * called from the callback: the delivered buffer is kept after the callback returns
+     * and a spare buffer is queued instead. Returns false if no spare buffer is free,
+     * the buffer is requeued as usual then.
+     * Held buffers must be released before the device is destroyed.
+     */
+    bool holdBuffer(const Buffer &);
+
+    /* returns the held buffer (Buffer::index) to the pool, thread safe */
+    void releaseBuffer(unsigned int index);
+
+    // ========= Region of interest ======= //
+
+    /* can be changed while capturing, the sensor's crop is kept if the driver doesn't allow it */
+    void setRoi(const struct v4l2_rect &);
+
+    /* delivered region in the captured frame's coordinates */
+    struct v4l2_rect getRoi() const;
+
+    /* true if the region is cropped by the sensor */
+    bool isHardwareCrop() const;
+
+    // ============= Controls ============= //
+
+    int getControl(unsigned int id);
+
+    void setControl(unsigned int id, int value);
+
     // ============== Stream ============== //
 
     void stopCapturing();
@@ -120,20 +259,68 @@ private:
     /* capturing state flag, thread safe */
     atomic<bool> _is_capturing;
 
+    /* streaming thread runs until the device is destroyed */
+    atomic<bool> _is_running;
+
     /* internal device parameters, capabilities, etc. */
     v4l2_device_param _parameters;
     v4l2_capability   _capability;
     v4l2_format       _format;
     v4l2_streamparm   _stream_parameters;
 
+    /* memory mode in use, see v4l2_device_param::memory */
+    unsigned int _memory;
+
     /* frames' buffers */
     vector<Buffer> _buffers;
 
+    /*
+     * buffers queued to the driver: USERPTR driver's index -> buffer in the pool,
+     * MMAP queue position -> buffer (its own driver's index); a held buffer is replaced by a spare one
+     */
+    vector<unsigned int> _slots;
+
+    /* spare buffers, neither queued nor held */
+    vector<unsigned int> _free_buffers;
+    mutex _pool_mutex;
+
+    /* spare buffer which replaces the held one in the current slot, set by holdBuffer */
+    int _swap_buffer;
+    unsigned int _delivered_buffer;
+
+    /*
+     * region of interest: _crop is the captured area in the frame's coordinates
+     * (the sensor's crop or the full frame), _roi is the delivered area inside it;
+     * _default_crop is the full frame in the sensor's coordinates (VIDIOC_S_SELECTION),
+     * width 0 if the frame can't be mapped to the sensor
+     */
+    bool _hardware_crop;
+    struct v4l2_rect _crop;
+    struct v4l2_rect _roi;
+    struct v4l2_rect _default_crop;
+
     /* callback function, it's invoked when frame's read */
     function<void(const Buffer&, const struct v4l2_buffer&)> _callback;
 
     /* multithreading */
     mutex _stream_mutex;
+    thread _stream_thread;
+
+    /* change detection gate */
+    FrameChangeDetector _change_detector;
+    unsigned int _frames_since_delivery;
+
+    /* stream statistics, thread safe */
+    atomic<unsigned long long> _frames_captured;
+    atomic<unsigned long long> _frames_delivered;
+    atomic<unsigned long long> _frames_skipped;
+    atomic<unsigned long long> _frames_dropped;
+
+    /* glass-to-consumer latency (in microseconds), measured after the callback */
+    atomic<unsigned long long> _latency_last;
+    atomic<unsigned long long> _latency_sum;
+    atomic<unsigned long long> _latency_count;
+    atomic<unsigned long long> _latency_max;
 
     // ========= Initialization ========== //
 
@@ -147,10 +334,38 @@ private:
 
     void init_buffers();
 
+    void init_spare_buffers();
+
     void init_mmap();
 
+    bool init_userptr();
+
+    void *allocate_user_buffer(size_t&);
+
+    void export_buffers();
+
     void init_fps();
 
+    void init_roi();
+
+    bool get_default_crop(struct v4l2_rect&);
+
+    struct v4l2_rect to_sensor(const struct v4l2_rect&) const;
+
+    struct v4l2_rect to_frame(const struct v4l2_rect&) const;
+
+    bool set_crop(struct v4l2_rect&);
+
+    bool fits_buffers() const;
+
+    bool apply_hardware_crop(const struct v4l2_rect&);
+
+    void reset_hardware_crop();
+
+    void apply_software_roi(const struct v4l2_rect&);
+
+    void refresh_format();
+
     // =========== Destruction ============ //
 
     void uninit_device();
@@ -163,44 +378,13 @@ private:
 
     bool read_frame();
 
-    void stream();
-};
+    bool dequeue_buffer(struct v4l2_buffer&);
 
+    void update_latency(const struct v4l2_buffer&);
 
-/*
- * Taken from libv4l2
- * TODO move to separate header/source
- */
+    bool pass_change_gate(const Buffer&);
 
-#define CLIP(color) (unsigned char)(((color) > 0xFF) ? 0xFF : (((color) < 0) ? 0 : (color)))
-
-static void v4lconvert_yuyv_to_rgb24(
-        const unsigned char* source,
-        unsigned char *dest,
-        int width, int height, int stride)
-{
-    int j;
-
-    while (--height >= 0) {
-        for (j = 0; j + 1 < width; j += 2) {
-            int u = source[1];
-            int v = source[3];
-            int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
-            int rg = (((u - 128) << 1) +  (u - 128) +
-                      ((v - 128) << 2) + ((v - 128) << 1)) >> 3;
-            int v1 = (((v - 128) << 1) +  (v - 128)) >> 1;
-
-            *dest++ = CLIP(source[0] + v1);
-            *dest++ = CLIP(source[0] - rg);
-            *dest++ = CLIP(source[0] + u1);
-
-            *dest++ = CLIP(source[2] + v1);
-            *dest++ = CLIP(source[2] - rg);
-            *dest++ = CLIP(source[2] + u1);
-            source += 4;
-        }
-        source += stride - (width * 2);
-    }
-}
+    void stream();
+};
 
 #endif // V4L2DEVICE_H
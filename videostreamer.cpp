@@ -1,82 +1,159 @@
 #include "videostreamer.h"
 #include "ui_videostreamer.h"
-#include <QPainter>
 #include <QDebug>
-#include <QByteArray>
+#include <QGridLayout>
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
+/* status bar update period (ms) */
+#define STATUS_INTERVAL 1000
+
 VideoStreamer::VideoStreamer(v4l2_device_param param, bool mainCamera, QWidget *parent) :
   QMainWindow(parent),
   ui(new Ui::VideoStreamer),
+  _has_pending(false),
+  _presenting(false),
+  _captured_frames(0),
+  _converted_frames(0),
+  _presented_frames(0),
   _capture(new V4L2Device(param))
 {
   ui->setupUi(this);
 
-  _width =  (int) _capture->getWidth();
-  _height = (int) _capture->getHeight();
-  _stride = (int) _capture->getStride();
+  struct v4l2_rect roi = _capture->getRoi();
 
-  if (mainCamera) {
+  _back    = QImage(roi.width, roi.height, QImage::Format_RGB32);
+  _pending = QImage(roi.width, roi.height, QImage::Format_RGB32);
+  _front   = QImage();
 
-      _capture->setCallback([&](const Buffer& buffer, const struct v4l2_buffer& buffer_info) {
+  // the view fills the window, the stream button stays on top of it
+  _view = new FrameView(ui->centralwidget);
+  _view->setImage(&_front);
 
-          QImage img = QImage(_width, _height, QImage::Format_RGB888);
+  QGridLayout *layout = new QGridLayout(ui->centralwidget);
+  layout->setContentsMargins(0, 0, 0, 0);
+  layout->addWidget(_view, 0, 0);
+  layout->addWidget(ui->streamButton, 0, 0, Qt::AlignTop | Qt::AlignLeft);
+  ui->streamButton->raise();
+
+  if (mainCamera) {
 
-          unsigned char *rgb_data = img.bits();
+      _capture->setCallback([this](const Buffer& buffer, const struct v4l2_buffer&) {
 
-          v4lconvert_yuyv_to_rgb24((const unsigned char*) buffer.data, rgb_data, _width, _height, _stride);
+          resizeBack(buffer);
 
-          emit renderedImage(img);
+          // only the region of interest is converted, straight from the captured buffer
+          v4lconvert_yuyv_to_rgb32((const unsigned char*) buffer.image, _back.bits(),
+                                   buffer.width, buffer.height, buffer.stride, _back.bytesPerLine());
 
+          publishFrame();
         });
 
     } else {
 
-      _capture->setCallback([&](const Buffer& buffer, const struct v4l2_buffer& buffer_info) {
+      _rgb8 = cv::Mat(roi.height, roi.width, CV_8UC3);
 
-          cv::Mat bayer8 =  cv::Mat(_height, _width, CV_8UC1, (uchar*) buffer.data);
-          cv::Mat rgb8 =  cv::Mat(_height, _width, CV_8UC3);
+      _capture->setCallback([this](const Buffer& buffer, const struct v4l2_buffer&) {
 
-          cv::cvtColor(bayer8, rgb8, CV_BayerGB2RGB);
+          resizeBack(buffer);
 
-          cv::Mat result = cv::Mat(_height, _width, CV_8UC3);
+          // the region's origin is even, the Bayer pattern is the same as the full frame's
+          cv::Mat bayer8 = cv::Mat(buffer.height, buffer.width, CV_8UC1, (uchar*) buffer.image, buffer.stride);
 
-          cv::cvtColor(rgb8, result, CV_BGR2RGB);
+          cv::cvtColor(bayer8, _rgb8, CV_BayerGB2RGB);
 
-          QImage img = QImage((const uchar*) result.data, result.cols,
-                              result.rows, result.step1(), QImage::Format_RGB888);
+          /* RGB32 is B, G, R, A in memory (little endian): same colors as the former BGR2RGB + RGB888 path */
+          cv::Mat result = cv::Mat(buffer.height, buffer.width, CV_8UC4, _back.bits(), _back.bytesPerLine());
 
-          img.bits();
+          cv::cvtColor(_rgb8, result, CV_RGB2RGBA);
 
-          emit renderedImage(img);
+          publishFrame();
         });
     }
 
-  // connect rendered image signal to set picture slot
-  connect(this, SIGNAL(renderedImage(QImage)), this, SLOT(setPicture(QImage)));
+  // the newest frame is presented once the previous one is on the screen
+  connect(_view, SIGNAL(frameSwapped()), this, SLOT(present()));
+
+  connect(&_status_timer, SIGNAL(timeout()), this, SLOT(showStatistics()));
+
+  _status_timer.start(STATUS_INTERVAL);
+  _fps_timer.start();
+}
+
+void VideoStreamer::resizeBack(const Buffer &buffer) {
 
-  setAutoFillBackground(true);
+  // the region of interest may change while streaming
+  if (_back.width() != (int) buffer.width || _back.height() != (int) buffer.height) {
+      _back = QImage(buffer.width, buffer.height, QImage::Format_RGB32);
+    }
 }
 
-void VideoStreamer::paintEvent(QPaintEvent *event) {
-  QPainter painter(this);
-  painter.setPen(Qt::white);
-  painter.setFont(QFont("Arial", 30));
-  painter.drawText(rect(), Qt::AlignCenter, "Qt");
-  painter.drawPixmap(this->rect(), pixmap);
+void VideoStreamer::publishFrame() {
+
+  {
+    lock_guard<mutex> lock(_frame_mutex);
+
+    // previous pending frame (if it wasn't presented) is reused for the next capture
+    _back.swap(_pending);
+    _has_pending = true;
+
+    // nothing on its way to the screen, no swap will come: start presenting
+    if (!_presenting) {
+        _presenting = true;
+        QMetaObject::invokeMethod(this, "present", Qt::QueuedConnection);
+      }
+  }
+
+  _converted_frames++;
 }
 
-void VideoStreamer::setPicture(const QImage& image) {
+void VideoStreamer::present() {
+
+  lock_guard<mutex> lock(_frame_mutex);
+
+  if (!_has_pending) {
+      _presenting = false; // idle until the next captured frame
+      return;
+    }
+
+  _front.swap(_pending);
+  _has_pending = false;
+
+  // the swapped out image may be the null one before the first frame
+  if (_pending.isNull()) {
+      _pending = QImage(_front.size(), QImage::Format_RGB32);
+    }
+
+  _presented_frames++;
+
+  // painted and swapped on the next vertical blank, then frameSwapped calls present again
+  _view->update();
+}
+
+void VideoStreamer::showStatistics() {
+
+  qint64 elapsed = _fps_timer.restart();
+
+  v4l2_stream_stats stats = _capture->getStreamStatistics();
+
+  // the gate skips frames before the callback, the device counts all of them
+  unsigned long long captured = stats.frames_captured - _captured_frames;
+  _captured_frames = stats.frames_captured;
+
+  statusBar()->showMessage(QString("captured %1 fps, converted %2 fps, presented %3 fps, skipped %4%, latency %5 ms")
+                           .arg(captured * 1000.0 / elapsed, 0, 'f', 1)
+                           .arg(_converted_frames.exchange(0) * 1000.0 / elapsed, 0, 'f', 1)
+                           .arg(_presented_frames * 1000.0 / elapsed, 0, 'f', 1)
+                           .arg(stats.skip_rate * 100, 0, 'f', 1)
+                           .arg(stats.latency_avg, 0, 'f', 1));
 
-  pixmap = QPixmap::fromImage(image);
-  update();
-  qApp->processEvents();
+  _presented_frames = 0;
 }
 
 VideoStreamer::~VideoStreamer()
 {
+  _status_timer.stop();
   delete ui;
 }
 
@@ -2,9 +2,15 @@
 #define VIDEOSTREAMER_H
 
 #include <memory>
+#include <mutex>
+#include <atomic>
 #include <QMainWindow>
-#include <QPixmap>
+#include <QImage>
+#include <QTimer>
+#include <QElapsedTimer>
 #include "v4l2device.h"
+#include "v4l2convert.h"
+#include "frameview.h"
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
@@ -22,25 +28,54 @@ public:
     VideoStreamer(v4l2_device_param, bool mainCamera = false, QWidget *parent = 0);
     ~VideoStreamer();
 
-    QPixmap pixmap;
-
-signals:
-    void renderedImage(const QImage&);
-
 private slots:
     void on_streamButton_clicked();
-    void setPicture(const QImage&);
+    void present();
+    void showStatistics();
 
 private:
     Ui::VideoStreamer *ui;
 
-    int _width;
-    int _height;
-    int _stride; // bytes per line
+    /*
+     * Triple buffering, all images are Format_RGB32 (blitted without conversion):
+     * _back is written by the capture thread, _pending holds the newest complete frame,
+     * _front is painted. Intermediate frames are overwritten in _pending.
+     */
+    QImage _back;
+    QImage _pending;
+    QImage _front;
+    bool _has_pending;
+    mutex _frame_mutex;
+
+    /* Bayer demosaicing buffer */
+    cv::Mat _rgb8;
+
+    /*
+     * Presentation is paced by the buffer swaps of the view: the next frame is presented
+     * when the previous one was swapped, at most one per vertical blank.
+     * _presenting is false while no frame is on its way to the screen (guarded by _frame_mutex).
+     */
+    FrameView *_view;
+    bool _presenting;
 
+    QTimer _status_timer;
+
+    /*
+     * captured (device's counter) vs converted (published by the callback, after the change gate)
+     * vs presented fps
+     */
+    unsigned long long _captured_frames;
+    atomic<unsigned int> _converted_frames;
+    unsigned int _presented_frames;
+    QElapsedTimer _fps_timer;
+
+    /* declared last, so the capture thread stops before the images are destroyed */
     unique_ptr<V4L2Device> _capture;
 
-    void paintEvent(QPaintEvent *event);
+    /* called by the capture thread */
+    void resizeBack(const Buffer &buffer);
+
+    void publishFrame();
 };
 
 #endif // VIDEOSTREAMER_H